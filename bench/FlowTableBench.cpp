@@ -0,0 +1,82 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "src/AppUtils.hpp"
+#include "src/RxStats.hpp"
+
+/**
+ * Measures the flow table of a group receiving from many senders: the
+ * inserts of the flows, the lookups of the flows already present in
+ * a random order and the walk of the flows sorted for the report.
+ *
+ * malt_bench [<Flows> [<Flow-Capacity>]]
+ */
+namespace malt {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double perSecond(uint64_t count, Clock::time_point start) {
+    std::chrono::duration<double> elapsed{Clock::now() - start};
+    return static_cast<double>(count) / elapsed.count();
+}
+
+void run(std::size_t flows, std::size_t flowCapacity) {
+    constexpr std::size_t Lookups{10'000'000};
+    constexpr uint16_t DPort{5000};
+
+    std::mt19937 rng{1};
+    std::vector<uint32_t> sources(flows);
+    for (auto& source: sources)
+        source = rng();
+
+    std::vector<uint32_t> order(Lookups);
+    for (auto& i: order)
+        i = static_cast<uint32_t>(rng() % flows);
+
+    GroupRxStats grs{flowCapacity};
+    uint64_t ts{0};
+
+    auto start = Clock::now();
+    for (std::size_t i{0}; i < flows; ++i)
+        grs.update(net::IPv4Address{sources[i]}, static_cast<uint16_t>(i),
+                DPort, 100, 64, ++ts);
+    double inserts = perSecond(flows, start);
+
+    start = Clock::now();
+    for (auto i: order)
+        grs.update(net::IPv4Address{sources[i]}, static_cast<uint16_t>(i),
+                DPort, 100, 64, ++ts);
+    double lookups = perSecond(Lookups, start);
+
+    uint64_t walked{0};
+    start = Clock::now();
+    grs.sortedForEach([&walked] (auto, auto, auto, auto const&) {
+        ++walked;
+    });
+    std::chrono::duration<double, std::milli> walk{Clock::now() - start};
+
+    fmt::print("flows: {}, flow capacity: {}\n", grs.size(), flowCapacity);
+    fmt::print("inserts: {:.2f} M/s\n", inserts / 1e6);
+    fmt::print("lookups: {:.2f} M/s\n", lookups / 1e6);
+    fmt::print("sorted walk: {:.0f} ms, {} flows\n", walk.count(), walked);
+}
+} // anon.namespace
+} // namespace malt
+
+int main(int argc, char const* const* argv) {
+    std::size_t flows{1'000'000};
+    std::size_t flowCapacity{8};
+    if (argc > 1)
+        flows = std::strtoul(argv[1], nullptr, 10);
+    if (argc > 2)
+        flowCapacity = std::strtoul(argv[2], nullptr, 10);
+    if (flows == 0 || flowCapacity == 0)
+        malt::appAbort("usage: malt_bench [<Flows> [<Flow-Capacity>]]");
+
+    malt::run(flows, flowCapacity);
+    return 0;
+}
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "vdunlib/time/Time.hpp"
+
+#include "AppUtils.hpp"
+#include "AsyncOutput.hpp"
+
+namespace malt {
+
+namespace {
+
+// The slots of a ring, the records of the full payloads are much larger
+constexpr unsigned PrefixSlots{4096};
+constexpr unsigned PayloadSlots{64};
+// The max number of the records shown from a ring before moving
+// on to the next one, which keeps the workers' lines interleaved
+constexpr unsigned MaxRecordsPerRing{64};
+constexpr auto IdleSleep = std::chrono::milliseconds{1};
+constexpr uint64_t ReportIntervalNs{1'000'000'000};
+
+} // anon.namespace
+
+AsyncOutput::AsyncOutput(Config const& cfg, OutputHandler& oh)
+: oh_{oh}
+, captureSize_{payloadCaptureSize(cfg.showPayload())}
+, done_{false}
+, nextReportNs_{0} {
+    unsigned slots = cfg.showPayload() ? PayloadSlots : PrefixSlots;
+    for (unsigned w{0}; w < cfg.threads(); ++w)
+        queues_.push_back(std::make_unique<Queue>(slots, captureSize_));
+}
+
+void AsyncOutput::start() {
+    thread_ = std::thread{[this] { run(); }};
+}
+
+void AsyncOutput::stop() {
+    if (! thread_.joinable())
+        return;
+
+    done_.store(true, std::memory_order_release);
+    thread_.join();
+}
+
+void AsyncOutput::showRcvdPacket(unsigned worker, PacketInfo const& pinfo) {
+    Record* r = reserve(worker);
+    if (r == nullptr)
+        return;
+
+    r->kind = Record::Kind::Packet;
+    r->pinfo = pinfo;
+    r->pinfo.capturedSize = std::min(pinfo.capturedSize, captureSize_);
+    memcpy(SpscRing<Record>::extra(r), pinfo.payload, r->pinfo.capturedSize);
+    queues_[worker]->ring.commit();
+}
+
+void AsyncOutput::showTimeout(
+        unsigned worker, uint64_t ts, net::IPv4Address group) {
+    Record* r = reserve(worker);
+    if (r == nullptr)
+        return;
+
+    r->kind = Record::Kind::Timeout;
+    r->pinfo.timestamp = ts;
+    r->pinfo.group = group;
+    queues_[worker]->ring.commit();
+}
+
+void AsyncOutput::showFlowSummary(
+        unsigned worker, FlowSummary const& summary) {
+    Record* r = reserve(worker);
+    if (r == nullptr)
+        return;
+
+    r->kind = Record::Kind::Summary;
+    r->summary = summary;
+    queues_[worker]->ring.commit();
+}
+
+void AsyncOutput::showLatencySummary(
+        unsigned worker, LatencySummary const& summary) {
+    Record* r = reserve(worker);
+    if (r == nullptr)
+        return;
+
+    r->kind = Record::Kind::Latency;
+    r->latency = summary;
+    queues_[worker]->ring.commit();
+}
+
+void AsyncOutput::showSeqGap(unsigned worker, SeqGap const& gap) {
+    Record* r = reserve(worker);
+    if (r == nullptr)
+        return;
+
+    r->kind = Record::Kind::Gap;
+    r->gap = gap;
+    queues_[worker]->ring.commit();
+}
+
+uint64_t AsyncOutput::droppedLines() const {
+    uint64_t dropped{0};
+    for (auto const& q: queues_)
+        dropped += q->dropped.load(std::memory_order_relaxed);
+    return dropped;
+}
+
+AsyncOutput::Record* AsyncOutput::reserve(unsigned worker) {
+    Queue& q = *queues_[worker];
+    Record* r = q.ring.reserve();
+    if (r == nullptr)
+        q.dropped.store(q.dropped.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+
+    return r;
+}
+
+/**
+ * Shows the records until it is stopped and all the rings are empty.
+ * The stop request is read before the rings, thus the records pushed
+ * before it are always shown.
+ */
+void AsyncOutput::run() {
+    while (true) {
+        bool done = done_.load(std::memory_order_acquire);
+        bool shown = showRecords();
+        reportDropped(done && ! shown);
+
+        if (! shown) {
+            if (done)
+                break;
+
+            std::this_thread::sleep_for(IdleSleep);
+        }
+    }
+}
+
+/**
+ * @return true if any record was shown
+ */
+bool AsyncOutput::showRecords() {
+    bool shown{false};
+    for (auto& q: queues_) {
+        for (unsigned i{0}; i < MaxRecordsPerRing; ++i) {
+            Record* r = q->ring.front();
+            if (r == nullptr)
+                break;
+
+            switch (r->kind) {
+            case Record::Kind::Packet:
+                r->pinfo.payload = SpscRing<Record>::extra(r);
+                oh_.showRcvdPacket(r->pinfo);
+                break;
+
+            case Record::Kind::Timeout:
+                oh_.showTimeout(r->pinfo.timestamp, r->pinfo.group);
+                break;
+
+            case Record::Kind::Summary:
+                oh_.showFlowSummary(r->summary);
+                break;
+
+            case Record::Kind::Latency:
+                oh_.showLatencySummary(r->latency);
+                break;
+
+            case Record::Kind::Gap:
+                oh_.showSeqGap(r->gap);
+                break;
+            }
+
+            q->ring.pop();
+            shown = true;
+        }
+    }
+
+    return shown;
+}
+
+void AsyncOutput::reportDropped(bool force) {
+    uint64_t hostNs = TimeUtils::gethostnanos();
+    if (! force && hostNs < nextReportNs_)
+        return;
+
+    uint64_t dropped{0};
+    for (auto& q: queues_) {
+        uint64_t total = q->dropped.load(std::memory_order_relaxed);
+        dropped += total - q->reported;
+        q->reported = total;
+    }
+
+    if (dropped > 0) {
+        oh_.showDroppedLines(hostNs, dropped);
+        nextReportNs_ = hostNs + ReportIntervalNs;
+    }
+}
+
+} // namespace malt
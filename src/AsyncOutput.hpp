@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "vdunlib/net/IPv4Address.hpp"
+
+#include "PacketInfo.hpp"
+#include "Config.hpp"
+#include "OutputHandler.hpp"
+#include "RxStats.hpp"
+#include "SpscRing.hpp"
+
+namespace malt {
+
+/**
+ * Moves the formatting and the writing of the received packets out of
+ * the receiver workers. Every worker pushes compact records of its
+ * packets and timeouts into its own SPSC ring and a single output
+ * thread shows them through the OutputHandler, thus a slow terminal or
+ * pipe can't stall the reception. The records carry a copy of the
+ * captured payload, which the policy reuses once the batch is released.
+ *
+ * If a ring is full, the record is dropped and counted instead. The
+ * output thread reports the dropped lines at most once per second.
+ */
+class AsyncOutput final {
+public:
+    AsyncOutput(Config const& cfg, OutputHandler& oh);
+
+    AsyncOutput(AsyncOutput const&) = delete;
+    AsyncOutput& operator= (AsyncOutput const&) = delete;
+
+    ~AsyncOutput() { stop(); }
+
+    void start();
+
+    /**
+     * Shows the records pushed so far and stops the output thread.
+     * The workers must not push any more records.
+     */
+    void stop();
+
+    /**
+     * May only be called by the worker with the index.
+     */
+    void showRcvdPacket(unsigned worker, PacketInfo const& pinfo);
+
+    /**
+     * May only be called by the worker with the index.
+     */
+    void showTimeout(unsigned worker, uint64_t ts, net::IPv4Address group);
+
+    /**
+     * May only be called by the worker with the index.
+     */
+    void showFlowSummary(unsigned worker, FlowSummary const& summary);
+
+    /**
+     * May only be called by the worker with the index.
+     */
+    void showLatencySummary(unsigned worker, LatencySummary const& summary);
+
+    /**
+     * May only be called by the worker with the index.
+     */
+    void showSeqGap(unsigned worker, SeqGap const& gap);
+
+    /**
+     * @return the number of the records dropped by all the workers
+     */
+    uint64_t droppedLines() const;
+
+private:
+    struct Record final {
+        enum class Kind: uint8_t {
+            Packet,
+            Timeout,
+            Summary,
+            Latency,
+            Gap
+        };
+
+        Kind kind;
+        // Only the member of the kind is set, the records are copied
+        // into the raw slots of the ring and never constructed
+        union {
+            // The packet and the timeout, the payload points to the
+            // bytes following the record
+            PacketInfo pinfo;
+            FlowSummary summary;
+            LatencySummary latency;
+            SeqGap gap;
+        };
+    };
+    static_assert(std::is_trivially_copyable<Record>::value,
+                  "the records are copied into the raw slots");
+
+    struct Queue final {
+        Queue(unsigned slots, std::size_t extra)
+        : ring{slots, extra}, dropped{0}, reported{0} {}
+
+        SpscRing<Record> ring;
+        // Written by the worker
+        std::atomic<uint64_t> dropped;
+        // The part of dropped already reported by the output thread
+        uint64_t reported;
+    };
+
+    OutputHandler& oh_;
+    unsigned const captureSize_;
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::atomic<bool> done_;
+    std::thread thread_;
+    uint64_t nextReportNs_;
+
+    /**
+     * @return the slot to fill in or nullptr if the record is dropped
+     */
+    Record* reserve(unsigned worker);
+
+    void run();
+
+    bool showRecords();
+
+    void reportDropped(bool force);
+};
+
+} // namespace malt
@@ -0,0 +1,170 @@
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/filter.h>
+#include <cstdint>
+#include <vector>
+
+#include "AppUtils.hpp"
+#include "BpfFilter.hpp"
+
+namespace malt {
+
+namespace {
+
+// The offset of the IPv4 fragment offset field
+constexpr uint32_t IPFragOff{6};
+constexpr uint32_t IPProto{9};
+constexpr uint32_t IPSAddr{12};
+constexpr uint32_t IPDAddr{16};
+constexpr uint32_t UDPSPort{0};
+// The groups are matched one by one up to this number, the larger
+// group lists are only matched by their address range
+constexpr std::size_t MaxFilterGroups{64};
+
+/**
+ * Builds a BPF program whose jumps may target the common drop and
+ * accept instructions placed at the end of the program. The jump
+ * offsets of the classic BPF are only 8 bit wide, thus the programs
+ * must remain short.
+ */
+class ProgramBuilder final {
+public:
+    // Jump targets other than the relative offsets
+    static constexpr int Drop{-1};
+    static constexpr int Accept{-2};
+
+    void stmt(uint16_t code, uint32_t k) {
+        insns_.push_back(Insn{BPF_STMT(code, k), 0, 0});
+    }
+
+    void jump(uint16_t code, uint32_t k, int jt, int jf) {
+        insns_.push_back(Insn{BPF_JUMP(code, k, 0, 0), jt, jf});
+    }
+
+    explicit ProgramBuilder(uint32_t snapLen): snapLen_{snapLen} {}
+
+    std::vector<sock_filter> build() {
+        auto dropPos = insns_.size();
+        auto acceptPos = dropPos + 1;
+
+        std::vector<sock_filter> prog;
+        prog.reserve(acceptPos + 1);
+        for (std::size_t i{0}; i < insns_.size(); ++i) {
+            auto insn = insns_[i].insn;
+            insn.jt = target(insns_[i].jt, i, dropPos, acceptPos);
+            insn.jf = target(insns_[i].jf, i, dropPos, acceptPos);
+            prog.push_back(insn);
+        }
+        prog.push_back(BPF_STMT(BPF_RET | BPF_K, 0));
+        prog.push_back(BPF_STMT(BPF_RET | BPF_K, snapLen_));
+
+        return prog;
+    }
+
+private:
+    struct Insn {
+        sock_filter insn;
+        int jt;
+        int jf;
+    };
+
+    uint32_t snapLen_;
+    std::vector<Insn> insns_;
+
+    static uint8_t target(int t, std::size_t pos,
+            std::size_t dropPos, std::size_t acceptPos) {
+        if (t == Drop) return static_cast<uint8_t>(dropPos - pos - 1);
+        if (t == Accept) return static_cast<uint8_t>(acceptPos - pos - 1);
+        return static_cast<uint8_t>(t);
+    }
+};
+
+} // anon.namespace
+
+std::vector<sock_filter> makeUdpFilter(Config const& cfg, uint32_t snapLen) {
+    ProgramBuilder pb{snapLen};
+
+    pb.stmt(BPF_LD | BPF_B | BPF_ABS, IPProto);
+    pb.jump(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, ProgramBuilder::Drop);
+
+    // The groups are sorted, a match skips the rest of the groups
+    auto const& groups = cfg.groups();
+    pb.stmt(BPF_LD | BPF_W | BPF_ABS, IPDAddr);
+    if (groups.size() <= MaxFilterGroups) {
+        for (std::size_t i{0}; i < groups.size(); ++i) {
+            int left = static_cast<int>(groups.size() - i - 1);
+            pb.jump(BPF_JMP | BPF_JEQ | BPF_K, groups[i].value(),
+                    left, left == 0 ? ProgramBuilder::Drop : 0);
+        }
+    } else {
+        pb.jump(BPF_JMP | BPF_JGE | BPF_K,
+                groups.front().value(), 0, ProgramBuilder::Drop);
+        pb.jump(BPF_JMP | BPF_JGT | BPF_K,
+                groups.back().value(), ProgramBuilder::Drop, 0);
+    }
+
+    if (cfg.source() != net::IPv4Address{}) {
+        pb.stmt(BPF_LD | BPF_W | BPF_ABS, IPSAddr);
+        pb.jump(BPF_JMP | BPF_JEQ | BPF_K,
+                cfg.source().value(), 0, ProgramBuilder::Drop);
+    }
+
+    if (cfg.sports().empty()) {
+        pb.stmt(BPF_RET | BPF_K, snapLen);
+        return pb.build();
+    }
+
+    // The non-first fragments carry no UDP header
+    pb.stmt(BPF_LD | BPF_H | BPF_ABS, IPFragOff);
+    pb.jump(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, ProgramBuilder::Drop, 0);
+    // X = IP header length, A = UDP source port
+    pb.stmt(BPF_LDX | BPF_B | BPF_MSH, 0);
+    pb.stmt(BPF_LD | BPF_H | BPF_IND, 0);
+
+    // Falling through the last range jumps to the drop instruction
+    for (auto const& r: cfg.sports()) {
+        pb.jump(BPF_JMP | BPF_JGE | BPF_K, r.first, 0, 1);
+        pb.jump(BPF_JMP | BPF_JGT | BPF_K,
+                r.last, 0, ProgramBuilder::Accept);
+    }
+
+    return pb.build();
+}
+
+std::vector<sock_filter> makeShardFilter(unsigned shard, unsigned shards) {
+    ProgramBuilder pb{FullSnapLen};
+
+    // The packet data of a UDP socket starts with the UDP header,
+    // the IP header is reachable only relative to the network header
+    pb.stmt(BPF_LD | BPF_W | BPF_ABS,
+            static_cast<uint32_t>(SKF_NET_OFF) + IPSAddr);
+    pb.stmt(BPF_ST, 0);
+    pb.stmt(BPF_LD | BPF_H | BPF_ABS, UDPSPort);
+    pb.stmt(BPF_LDX | BPF_W | BPF_MEM, 0);
+    pb.stmt(BPF_ALU | BPF_XOR | BPF_X, 0);
+    // Fibonacci hashing spreads the adjacent addresses and ports
+    pb.stmt(BPF_ALU | BPF_MUL | BPF_K, 0x9e3779b1);
+    pb.stmt(BPF_ALU | BPF_RSH | BPF_K, 16);
+    pb.stmt(BPF_ALU | BPF_MOD | BPF_K, shards);
+    pb.jump(BPF_JMP | BPF_JEQ | BPF_K,
+            shard, ProgramBuilder::Accept, ProgramBuilder::Drop);
+
+    return pb.build();
+}
+
+bool attachFilter(int s, std::vector<sock_filter> const& prog) {
+    sock_fprog fprog{};
+    fprog.len = static_cast<unsigned short>(prog.size());
+    fprog.filter = const_cast<sock_filter*>(prog.data());
+
+    if (setsockopt(s, SOL_SOCKET,
+            SO_ATTACH_FILTER, &fprog, sizeof(fprog)) == -1) {
+        warning("failed to attach the kernel filter, the packets will "
+                "be filtered by malt only: ", sysError(errno));
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace malt
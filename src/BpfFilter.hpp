@@ -0,0 +1,47 @@
+#pragma once
+
+#include <linux/filter.h>
+#include <cstdint>
+#include <vector>
+
+#include "Config.hpp"
+
+namespace malt {
+
+// Makes the filter pass the accepted packets to the socket in full
+constexpr uint32_t FullSnapLen{0x40000};
+
+/**
+ * Creates a classic BPF program accepting only the UDP datagrams
+ * destined for the configured multicast groups and, if configured,
+ * sent from the source and the source port ranges. Large group lists
+ * are only matched by their address range and the rest of the packets
+ * is filtered by malt. The program
+ * expects the packet data to start with the IPv4 header, which is
+ * the case for the raw IP sockets and the SOCK_DGRAM packet sockets.
+ *
+ * @param snapLen the number of bytes of the accepted packets passed
+ * to the socket
+ */
+std::vector<sock_filter> makeUdpFilter(
+        Config const&, uint32_t snapLen = FullSnapLen);
+
+/**
+ * Creates a classic BPF program for a regular UDP socket which accepts
+ * only the shard of the flows assigned to the socket. The flows are
+ * hashed by their source address and port, thus all the datagrams of
+ * a flow are received by the same socket.
+ *
+ * @param shard the index of the socket's shard
+ * @param shards the number of the shards
+ */
+std::vector<sock_filter> makeShardFilter(unsigned shard, unsigned shards);
+
+/**
+ * Attaches the filter program to the socket.
+ *
+ * @return true if the program was attached, false otherwise
+ */
+bool attachFilter(int s, std::vector<sock_filter> const&);
+
+} // namespace malt
@@ -0,0 +1,442 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "AppUtils.hpp"
+#include "CaptureReader.hpp"
+
+namespace malt {
+
+namespace {
+
+constexpr uint32_t PcapMagicMicros{0xa1b2c3d4};
+constexpr uint32_t PcapMagicNanos{0xa1b23c4d};
+constexpr std::size_t PcapFileHdrSize{24};
+constexpr std::size_t PcapRecordHdrSize{16};
+
+constexpr uint32_t SectionHeaderBlock{0x0a0d0d0a};
+constexpr uint32_t InterfaceDescriptionBlock{1};
+constexpr uint32_t SimplePacketBlock{3};
+constexpr uint32_t EnhancedPacketBlock{6};
+constexpr uint32_t ByteOrderMagic{0x1a2b3c4d};
+constexpr uint16_t OptEndOfOpt{0};
+constexpr uint16_t OptIfTsResol{9};
+// The block type, the block length and the trailing block length
+constexpr std::size_t BlockOverhead{12};
+
+constexpr uint32_t LinkTypeNull{0};
+constexpr uint32_t LinkTypeEthernet{1};
+constexpr uint32_t LinkTypeRawBsd{12};
+constexpr uint32_t LinkTypeRawOpenBsd{14};
+constexpr uint32_t LinkTypeRaw{101};
+constexpr uint32_t LinkTypeLoop{108};
+constexpr uint32_t LinkTypeLinuxSll{113};
+constexpr uint32_t LinkTypeIPv4{228};
+constexpr uint32_t LinkTypeLinuxSll2{276};
+
+constexpr uint16_t EtherTypeIPv4{0x0800};
+constexpr uint16_t EtherTypeVlan{0x8100};
+constexpr uint16_t EtherTypeQinQ{0x88a8};
+constexpr std::size_t EtherHdrSize{14};
+constexpr std::size_t VlanTagSize{4};
+constexpr std::size_t LinuxSllHdrSize{16};
+constexpr std::size_t LinuxSll2HdrSize{20};
+constexpr std::size_t NullHdrSize{4};
+constexpr uint32_t NullFamilyIPv4{2};
+constexpr std::size_t IPv4MinHdrSize{20};
+// The end of the total length field of the IPv4 header
+constexpr std::size_t IPv4TotLenEnd{4};
+
+constexpr std::size_t pad4(std::size_t size) { return (size + 3) & ~3ul; }
+
+uint16_t be16(uint8_t const* p) {
+    return static_cast<uint16_t>((p[0] << 8u) | p[1]);
+}
+
+uint32_t load32(uint8_t const* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+} // anon.namespace
+
+CaptureReader::CaptureReader()
+: fd_{-1}
+, map_{nullptr}
+, size_{0}
+, offset_{0}
+, recordOffset_{0}
+, pcapng_{false}
+, swapped_{false} {}
+
+CaptureReader::~CaptureReader() {
+    if (map_ != nullptr)
+        munmap(const_cast<uint8_t*>(map_), size_);
+
+    if (fd_ != -1) {
+        int rc;
+        do {
+            rc = close(fd_);
+        } while (rc == -1 && errno == EINTR);
+    }
+}
+
+bool CaptureReader::open(std::string const& path) {
+    path_ = path;
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ == -1)
+        return error("cannot open capture file ", path, ": ",
+                     sysError(errno));
+
+    struct stat st{};
+    if (fstat(fd_, &st) == -1)
+        return error("cannot get the size of capture file ", path, ": ",
+                     sysError(errno));
+
+    size_ = static_cast<std::size_t>(st.st_size);
+    if (size_ < sizeof(uint32_t))
+        return error("capture file ", path, " is not a pcap or pcapng file");
+
+    void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (map == MAP_FAILED)
+        return error("cannot map capture file ", path, ": ",
+                     sysError(errno));
+
+    map_ = static_cast<uint8_t const*>(map);
+    // The file is read only once front to back, thus the kernel may
+    // read ahead aggressively and drop the pages behind
+    madvise(map, size_, MADV_SEQUENTIAL);
+
+    uint32_t magic = load32(map_);
+    if (magic == SectionHeaderBlock) {
+        pcapng_ = true;
+        return true;
+    }
+
+    if (magic == PcapMagicMicros || magic == PcapMagicNanos)
+        swapped_ = false;
+    else if (magic == __builtin_bswap32(PcapMagicMicros)
+             || magic == __builtin_bswap32(PcapMagicNanos))
+        swapped_ = true;
+    else
+        return error("capture file ", path, " is not a pcap or pcapng file");
+
+    if (size_ < PcapFileHdrSize)
+        return malformed("truncated file header");
+
+    bool nanos = u32(map_) == PcapMagicNanos;
+    intfs_.push_back(Interface{
+            u32(map_ + 20) & 0xffffu, nanos ? 1ul : 1'000ul, 0});
+    offset_ = PcapFileHdrSize;
+    return true;
+}
+
+CaptureReader::Result CaptureReader::next(CapturedPacket& pkt) {
+    return pcapng_ ? nextPcapng(pkt) : nextPcap(pkt);
+}
+
+uint16_t CaptureReader::u16(uint8_t const* p) const {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return swapped_ ? __builtin_bswap16(v) : v;
+}
+
+uint32_t CaptureReader::u32(uint8_t const* p) const {
+    uint32_t v = load32(p);
+    return swapped_ ? __builtin_bswap32(v) : v;
+}
+
+bool CaptureReader::malformed(char const* what) {
+    return error("capture file ", path_, " is malformed at offset ",
+                 recordOffset_, ": ", what);
+}
+
+CaptureReader::Result CaptureReader::nextPcap(CapturedPacket& pkt) {
+    Interface const& intf = intfs_.front();
+    while (offset_ < size_) {
+        recordOffset_ = offset_;
+        if (size_ - offset_ < PcapRecordHdrSize) {
+            malformed("truncated record header");
+            return Result::Failed;
+        }
+
+        uint8_t const* rec = map_ + offset_;
+        std::size_t captured = u32(rec + 8);
+        if (size_ - offset_ - PcapRecordHdrSize < captured) {
+            malformed("truncated record");
+            return Result::Failed;
+        }
+        offset_ += PcapRecordHdrSize + captured;
+
+        // The fraction is in microseconds or nanoseconds
+        pkt.timestamp = static_cast<uint64_t>(u32(rec)) * 1'000'000'000
+                + static_cast<uint64_t>(u32(rec + 4)) * intf.tsMul;
+        pkt.data = rec + PcapRecordHdrSize;
+        pkt.capturedSize = captured;
+        pkt.origSize = u32(rec + 12);
+        if (skipLinkHeader(intf.linkType, pkt))
+            return Result::Packet;
+    }
+
+    return Result::End;
+}
+
+CaptureReader::Result CaptureReader::nextPcapng(CapturedPacket& pkt) {
+    while (offset_ < size_) {
+        recordOffset_ = offset_;
+        if (size_ - offset_ < BlockOverhead) {
+            malformed("truncated block header");
+            return Result::Failed;
+        }
+
+        uint8_t const* block = map_ + offset_;
+        uint32_t type = load32(block);
+        // The byte order of the section is only known from its header
+        if (type == SectionHeaderBlock) {
+            if (size_ - offset_ < BlockOverhead + 4) {
+                malformed("truncated section header");
+                return Result::Failed;
+            }
+            uint32_t bom = load32(block + 8);
+            if (bom != ByteOrderMagic
+                && bom != __builtin_bswap32(ByteOrderMagic)) {
+                malformed("invalid byte order magic");
+                return Result::Failed;
+            }
+            swapped_ = bom != ByteOrderMagic;
+        } else {
+            type = u32(block);
+        }
+
+        std::size_t length = u32(block + 4);
+        if (length < BlockOverhead || length % 4 != 0
+            || length > size_ - offset_) {
+            malformed("invalid block length");
+            return Result::Failed;
+        }
+        offset_ += length;
+
+        switch (type) {
+        case SectionHeaderBlock:
+            if (! readSectionHeader(block, length))
+                return Result::Failed;
+            continue;
+
+        case InterfaceDescriptionBlock:
+            if (! readInterface(block, length))
+                return Result::Failed;
+            continue;
+
+        case EnhancedPacketBlock: {
+            if (length < BlockOverhead + 20) {
+                malformed("truncated enhanced packet block");
+                return Result::Failed;
+            }
+            uint32_t intfId = u32(block + 8);
+            if (intfId >= intfs_.size()) {
+                malformed("packet of an undescribed interface");
+                return Result::Failed;
+            }
+            std::size_t captured = u32(block + 20);
+            if (pad4(captured) > length - BlockOverhead - 20) {
+                malformed("truncated enhanced packet block");
+                return Result::Failed;
+            }
+
+            Interface const& intf = intfs_[intfId];
+            uint64_t ts = (static_cast<uint64_t>(u32(block + 12)) << 32u)
+                    | u32(block + 16);
+            pkt.timestamp = intf.tsMul != 0 ? ts * intf.tsMul
+                    : ts / intf.tsDiv * 1'000'000'000
+                      + static_cast<uint64_t>(
+                              static_cast<unsigned __int128>(
+                                      ts % intf.tsDiv) * 1'000'000'000
+                              / intf.tsDiv);
+            pkt.data = block + 28;
+            pkt.capturedSize = captured;
+            pkt.origSize = u32(block + 24);
+            if (skipLinkHeader(intf.linkType, pkt))
+                return Result::Packet;
+            continue;
+        }
+
+        case SimplePacketBlock: {
+            if (intfs_.empty()) {
+                malformed("packet of an undescribed interface");
+                return Result::Failed;
+            }
+            if (length < BlockOverhead + 4) {
+                malformed("truncated simple packet block");
+                return Result::Failed;
+            }
+
+            // The simple packets have no timestamp and the captured
+            // size is limited by the block only
+            pkt.timestamp = 0;
+            pkt.data = block + 12;
+            pkt.origSize = u32(block + 8);
+            pkt.capturedSize = std::min<std::size_t>(
+                    pkt.origSize, length - BlockOverhead - 4);
+            if (skipLinkHeader(intfs_.front().linkType, pkt))
+                return Result::Packet;
+            continue;
+        }
+
+        default:
+            // The statistics, the name resolution and the custom blocks
+            continue;
+        }
+    }
+
+    return Result::End;
+}
+
+bool CaptureReader::readSectionHeader(
+        uint8_t const* block, std::size_t length) {
+    if (length < BlockOverhead + 16)
+        return malformed("truncated section header");
+
+    uint16_t major = u16(block + 12);
+    if (major != 1)
+        return malformed("unsupported pcapng version");
+
+    // The interface ids are local to the section
+    intfs_.clear();
+    return true;
+}
+
+bool CaptureReader::readInterface(uint8_t const* block, std::size_t length) {
+    if (length < BlockOverhead + 8)
+        return malformed("truncated interface description block");
+
+    // The timestamps are in microseconds unless the resolution
+    // option says otherwise
+    Interface intf{u16(block + 8), 1'000, 0};
+
+    uint8_t const* opt = block + 16;
+    uint8_t const* end = block + length - 4;
+    while (end - opt >= 4) {
+        uint16_t code = u16(opt);
+        std::size_t optLen = u16(opt + 2);
+        if (code == OptEndOfOpt)
+            break;
+        if (pad4(optLen) > static_cast<std::size_t>(end - opt - 4))
+            return malformed("truncated interface option");
+
+        if (code == OptIfTsResol && optLen == 1) {
+            uint8_t resol = opt[4];
+            unsigned exp = resol & 0x7fu;
+            uint64_t div = 1;
+            if (resol & 0x80u) {
+                if (exp > 63)
+                    return malformed("unsupported timestamp resolution");
+                div <<= exp;
+            } else {
+                if (exp > 19)
+                    return malformed("unsupported timestamp resolution");
+                for (unsigned i{0}; i < exp; ++i)
+                    div *= 10;
+            }
+
+            if (div <= 1'000'000'000 && 1'000'000'000 % div == 0) {
+                intf.tsMul = 1'000'000'000 / div;
+                intf.tsDiv = 0;
+            } else {
+                intf.tsMul = 0;
+                intf.tsDiv = div;
+            }
+        }
+
+        opt += 4 + pad4(optLen);
+    }
+
+    intfs_.push_back(intf);
+    return true;
+}
+
+bool CaptureReader::skipLinkHeader(uint32_t linkType, CapturedPacket& pkt) {
+    std::size_t hdrSize;
+    switch (linkType) {
+    case LinkTypeRaw:
+    case LinkTypeRawBsd:
+    case LinkTypeRawOpenBsd:
+    case LinkTypeIPv4:
+        hdrSize = 0;
+        break;
+
+    case LinkTypeEthernet: {
+        hdrSize = EtherHdrSize;
+        if (pkt.capturedSize < hdrSize)
+            return false;
+        uint16_t etherType = be16(pkt.data + hdrSize - 2);
+        while (etherType == EtherTypeVlan || etherType == EtherTypeQinQ) {
+            hdrSize += VlanTagSize;
+            if (pkt.capturedSize < hdrSize)
+                return false;
+            etherType = be16(pkt.data + hdrSize - 2);
+        }
+        if (etherType != EtherTypeIPv4)
+            return false;
+        break;
+    }
+
+    case LinkTypeLinuxSll:
+        hdrSize = LinuxSllHdrSize;
+        if (pkt.capturedSize < hdrSize
+            || be16(pkt.data + 14) != EtherTypeIPv4)
+            return false;
+        break;
+
+    case LinkTypeLinuxSll2:
+        hdrSize = LinuxSll2HdrSize;
+        if (pkt.capturedSize < hdrSize || be16(pkt.data) != EtherTypeIPv4)
+            return false;
+        break;
+
+    case LinkTypeNull:
+    case LinkTypeLoop: {
+        // The family is in the byte order of the capturing host
+        // for the null link type and in the network order for loop
+        hdrSize = NullHdrSize;
+        if (pkt.capturedSize < hdrSize)
+            return false;
+        uint32_t family = load32(pkt.data);
+        if (family != NullFamilyIPv4
+            && family != __builtin_bswap32(NullFamilyIPv4))
+            return false;
+        break;
+    }
+
+    default:
+        return false;
+    }
+
+    if (pkt.capturedSize < hdrSize + 1 || pkt.origSize < hdrSize)
+        return false;
+
+    pkt.data += hdrSize;
+    pkt.capturedSize -= hdrSize;
+    pkt.origSize -= hdrSize;
+    // Only the IPv4 packets, the link type may carry IPv6 as well
+    if ((pkt.data[0] >> 4u) != 4)
+        return false;
+
+    // The Ethernet frames shorter than the minimum are padded and some
+    // captures include the trailer, which is not a part of the packet
+    if (pkt.capturedSize >= IPv4TotLenEnd) {
+        std::size_t totLen = be16(pkt.data + IPv4TotLenEnd - 2);
+        if (totLen >= IPv4MinHdrSize && totLen < pkt.origSize) {
+            pkt.origSize = totLen;
+            pkt.capturedSize = std::min(pkt.capturedSize, totLen);
+        }
+    }
+
+    return true;
+}
+
+} // namespace malt
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace malt {
+
+/**
+ * A packet of a capture file. The data points into the mapping of
+ * the file, thus it is valid as long as the reader is.
+ */
+struct CapturedPacket final {
+    // Starts with the IPv4 header
+    uint8_t const* data;
+    std::size_t capturedSize;
+    std::size_t origSize;
+    // In nanoseconds since the epoch, 0 if the capture has none
+    uint64_t timestamp;
+};
+
+/**
+ * Reads the IPv4 packets of a pcap or pcapng file. The whole file is
+ * memory mapped and read sequentially, thus the packets are parsed in
+ * place without copying them. The link layer headers of the Ethernet,
+ * the Linux cooked and the raw IP captures are skipped and the packets
+ * other than IPv4 are silently skipped as well.
+ */
+class CaptureReader final {
+public:
+    enum class Result {
+        Packet,
+        End,
+        Failed
+    };
+
+    CaptureReader();
+
+    CaptureReader(CaptureReader const&) = delete;
+    CaptureReader& operator= (CaptureReader const&) = delete;
+
+    ~CaptureReader();
+
+    bool open(std::string const& path);
+
+    /**
+     * Reads the next IPv4 packet. If the file is malformed, the error
+     * is reported and Failed is returned.
+     */
+    Result next(CapturedPacket& pkt);
+
+private:
+    struct Interface final {
+        uint32_t linkType;
+        // Multiplies the timestamp into nanoseconds if not 0
+        uint64_t tsMul;
+        // Divides the timestamp into nanoseconds if tsMul is 0
+        uint64_t tsDiv;
+    };
+
+    std::string path_;
+    int fd_;
+    uint8_t const* map_;
+    std::size_t size_;
+    std::size_t offset_;
+    // The offset of the record or block being read
+    std::size_t recordOffset_;
+    bool pcapng_;
+    // The byte order of the file or the section differs from the host
+    bool swapped_;
+    // Only one interface in the pcap files
+    std::vector<Interface> intfs_;
+
+    uint16_t u16(uint8_t const* p) const;
+    uint32_t u32(uint8_t const* p) const;
+
+    bool malformed(char const* what);
+
+    Result nextPcap(CapturedPacket& pkt);
+    Result nextPcapng(CapturedPacket& pkt);
+
+    bool readSectionHeader(uint8_t const* block, std::size_t length);
+    bool readInterface(uint8_t const* block, std::size_t length);
+
+    /**
+     * Moves the packet data past the link layer header.
+     *
+     * @return false if the packet is not an IPv4 packet
+     */
+    static bool skipLinkHeader(uint32_t linkType, CapturedPacket& pkt);
+};
+
+} // namespace malt
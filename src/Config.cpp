@@ -1,7 +1,12 @@
+#include <sched.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <fstream>
 #include <tuple>
 #include <string>
+#include <vector>
 
 #include <fmt/format.h>
 #include <fmt/ostream.h>
@@ -17,6 +22,7 @@
 #include "Config.hpp"
 #include "AppUtils.hpp"
 #include "IPv4IntfList.hpp"
+#include "MaltBeaconHdr.hpp"
 // Generated file
 #include "Version.hpp"
 
@@ -25,8 +31,8 @@ namespace po = boost::program_options;
 namespace malt {
 
 namespace {
-struct GroupPort final {
-    net::IPv4Address group;
+struct GroupPorts final {
+    std::vector<net::IPv4Address> groups;
     uint16_t dport;
     bool wildcard;
 };
@@ -58,13 +64,14 @@ uint16_t getDPort(std::string const& portTxt) {
     return static_cast<uint16_t>(port);
 }
 
-GroupPort groupPort(
-        bool targetSpecified,
-        std::string const& groupPortTxt,
-        bool portSpecified, std::string& portTxt) {
-    if (! targetSpecified)
-        appAbort("no multicast target specified");
+struct GroupPort final {
+    net::IPv4Address group;
+    uint16_t dport;
+    bool wildcard;
+    bool portFound;
+};
 
+GroupPort groupPort(std::string const& groupPortTxt) {
     net::IPv4Address group{};
     uint16_t dport{0};
     bool wildcard{true};
@@ -90,24 +97,92 @@ GroupPort groupPort(
         group = getGroup(groupPortTxt);
     }
 
-    if (portSpecified) {
-        if (colonFound)
+    return GroupPort{
+        .group = group,
+        .dport = dport,
+        .wildcard = wildcard,
+        .portFound = colonFound
+    };
+}
+
+/**
+ * Reads the targets from a file with one target per line. The empty
+ * lines and the text following '#' are ignored.
+ */
+std::vector<std::string> readGroupsFile(
+        bool fileSpecified, std::string const& fileName) {
+    std::vector<std::string> targets;
+    if (! fileSpecified)
+        return targets;
+
+    std::ifstream in{fileName};
+    if (! in)
+        appAbort("cannot open groups file '", fileName, "'");
+
+    std::string line;
+    while (std::getline(in, line)) {
+        auto commentPos = line.find('#');
+        if (commentPos != std::string::npos)
+            line.erase(commentPos);
+
+        auto start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos)
+            continue;
+        auto end = line.find_last_not_of(" \t\r");
+        targets.push_back(line.substr(start, end - start + 1));
+    }
+
+    if (in.bad())
+        appAbort("failed to read groups file '", fileName, "'");
+
+    return targets;
+}
+
+GroupPorts groupPorts(
+        std::vector<std::string> const& targets,
+        bool portSpecified, std::string const& portTxt) {
+    if (targets.empty())
+        appAbort("no multicast target specified");
+
+    GroupPorts gps{};
+    gps.wildcard = true;
+    for (std::size_t i{0}; i < targets.size(); ++i) {
+        auto gp = groupPort(targets[i]);
+
+        if (portSpecified && gp.portFound)
             appAbort("option -p|--port may not be used if UDP port "
                      "is specified in the target");
 
-        dport = getDPort(portTxt);
-        wildcard = false;
+        if (i == 0) {
+            gps.dport = gp.dport;
+            gps.wildcard = gp.wildcard;
+        } else if (gp.dport != gps.dport || gp.wildcard != gps.wildcard) {
+            appAbort("all the groups must be received on the same "
+                     "UDP port, target '", targets[i], "' differs");
+        }
+
+        gps.groups.push_back(gp.group);
     }
 
-    return GroupPort{
-        .group = group,
-        .dport = dport,
-        .wildcard = wildcard
-    };
+    if (portSpecified) {
+        gps.dport = getDPort(portTxt);
+        gps.wildcard = false;
+    }
+
+    std::sort(gps.groups.begin(), gps.groups.end());
+    gps.groups.erase(
+            std::unique(gps.groups.begin(), gps.groups.end()),
+            gps.groups.end());
+
+    return gps;
 }
 
 net::IPv4Address checkMCastIntf(
-        bool intfSpecified, std::string const& intfTxt) {
+        bool intfSpecified, std::string const& intfTxt, bool replay) {
+    // The replayed packets are not received on any interface
+    if (! intfSpecified && replay)
+        return net::IPv4Address{};
+
     if (! intfSpecified)
         appAbort("the option '--intf' is required");
 
@@ -193,21 +268,476 @@ uint64_t getCount(bool countSpecified, std::string const& countTxt) {
             });
 }
 
+unsigned getBatch(bool batchSpecified, std::string const& batchTxt) {
+    if (! batchSpecified)
+        return 32;
+
+    auto batch = parseUInt64(batchTxt,
+            [&batchTxt] {
+                appAbort("invalid batch size '", batchTxt, "'");
+            },
+            [&batchTxt] {
+                appAbort("invalid batch size ", batchTxt);
+            });
+    if (batch == 0 || batch > 1024)
+        appAbort("invalid batch size ", batch);
+
+    return static_cast<unsigned>(batch);
+}
+
+std::vector<PortRange> getSPorts(
+        bool sportsSpecified, std::string const& sportsTxt) {
+    std::vector<PortRange> sports;
+    if (! sportsSpecified)
+        return sports;
+
+    std::string::size_type start{0};
+    while (start <= sportsTxt.length()) {
+        auto end = sportsTxt.find(',', start);
+        if (end == std::string::npos)
+            end = sportsTxt.length();
+
+        auto rangeTxt = sportsTxt.substr(start, end - start);
+        auto dashPos = rangeTxt.find('-');
+        PortRange range{};
+        if (dashPos == std::string::npos) {
+            range.first = getDPort(rangeTxt);
+            range.last = range.first;
+        } else {
+            range.first = getDPort(rangeTxt.substr(0, dashPos));
+            range.last = getDPort(rangeTxt.substr(dashPos + 1));
+            if (range.first > range.last)
+                appAbort("invalid UDP port range ", rangeTxt);
+        }
+        sports.push_back(range);
+
+        start = end + 1;
+    }
+
+    // The ranges are turned into a kernel filter program whose
+    // jump offsets are limited
+    if (sports.size() > 64)
+        appAbort("too many source port ranges, at most 64 are allowed");
+
+    return sports;
+}
+
+unsigned getBudget(bool budgetSpecified, std::string const& budgetTxt) {
+    if (! budgetSpecified)
+        return 0;
+
+    auto budget = parseUInt64(budgetTxt,
+            [&budgetTxt] {
+                appAbort("invalid budget '", budgetTxt, "'");
+            },
+            [&budgetTxt] {
+                appAbort("invalid budget ", budgetTxt);
+            });
+    if (budget > 1'000'000)
+        appAbort("invalid budget ", budget);
+
+    return static_cast<unsigned>(budget);
+}
+
+unsigned getThreads(bool threadsSpecified, std::string const& threadsTxt) {
+    if (! threadsSpecified)
+        return 1;
+
+    auto threads = parseUInt64(threadsTxt,
+            [&threadsTxt] {
+                appAbort("invalid number of threads '", threadsTxt, "'");
+            },
+            [&threadsTxt] {
+                appAbort("invalid number of threads ", threadsTxt);
+            });
+    if (threads == 0 || threads > 64)
+        appAbort("invalid number of threads ", threads);
+
+    return static_cast<unsigned>(threads);
+}
+
+unsigned getCpu(std::string const& cpuTxt) {
+    auto cpu = parseUInt64(cpuTxt,
+            [&cpuTxt] {
+                appAbort("invalid CPU '", cpuTxt, "'");
+            },
+            [&cpuTxt] {
+                appAbort("invalid CPU ", cpuTxt);
+            });
+    if (cpu >= CPU_SETSIZE)
+        appAbort("invalid CPU ", cpu);
+
+    return static_cast<unsigned>(cpu);
+}
+
+std::vector<unsigned> getCpus(
+        bool cpusSpecified, std::string const& cpusTxt) {
+    std::vector<unsigned> cpus;
+    if (! cpusSpecified)
+        return cpus;
+
+    std::string::size_type start{0};
+    while (start <= cpusTxt.length()) {
+        auto end = cpusTxt.find(',', start);
+        if (end == std::string::npos)
+            end = cpusTxt.length();
+
+        auto rangeTxt = cpusTxt.substr(start, end - start);
+        auto dashPos = rangeTxt.find('-');
+        if (dashPos == std::string::npos) {
+            cpus.push_back(getCpu(rangeTxt));
+        } else {
+            auto first = getCpu(rangeTxt.substr(0, dashPos));
+            auto last = getCpu(rangeTxt.substr(dashPos + 1));
+            if (first > last)
+                appAbort("invalid CPU range ", rangeTxt);
+            for (auto cpu = first; cpu <= last; ++cpu)
+                cpus.push_back(cpu);
+        }
+
+        start = end + 1;
+    }
+
+    return cpus;
+}
+
+unsigned getLineRate(
+        bool lineRateSpecified, std::string const& lineRateTxt) {
+    if (! lineRateSpecified)
+        return 0;
+
+    auto lineRate = parseUInt64(lineRateTxt,
+            [&lineRateTxt] {
+                appAbort("invalid line rate '", lineRateTxt, "'");
+            },
+            [&lineRateTxt] {
+                appAbort("invalid line rate ", lineRateTxt);
+            });
+    if (lineRate > 1'000'000)
+        appAbort("invalid line rate ", lineRate);
+
+    return static_cast<unsigned>(lineRate);
+}
+
+std::size_t getWriteSize(
+        bool writeSizeSpecified, std::string const& writeSizeTxt) {
+    if (! writeSizeSpecified)
+        return 64ul << 20u;
+
+    auto writeSize = parseUInt64(writeSizeTxt,
+            [&writeSizeTxt] {
+                appAbort("invalid capture file size '", writeSizeTxt, "'");
+            },
+            [&writeSizeTxt] {
+                appAbort("invalid capture file size ", writeSizeTxt);
+            });
+    if (writeSize == 0 || writeSize > 4096)
+        appAbort("invalid capture file size ", writeSize);
+
+    return static_cast<std::size_t>(writeSize) << 20u;
+}
+
+unsigned getWriteInterval(
+        bool writeIntervalSpecified, std::string const& writeIntervalTxt) {
+    if (! writeIntervalSpecified)
+        return 0;
+
+    auto writeInterval = parseUInt64(writeIntervalTxt,
+            [&writeIntervalTxt] {
+                appAbort("invalid capture file interval '",
+                         writeIntervalTxt, "'");
+            },
+            [&writeIntervalTxt] {
+                appAbort("invalid capture file interval ", writeIntervalTxt);
+            });
+    if (writeInterval > 86'400)
+        appAbort("invalid capture file interval ", writeInterval);
+
+    return static_cast<unsigned>(writeInterval);
+}
+
+unsigned getLatencyInterval(
+        bool latencyIntervalSpecified,
+        std::string const& latencyIntervalTxt) {
+    if (! latencyIntervalSpecified)
+        return 0;
+
+    auto latencyInterval = parseUInt64(latencyIntervalTxt,
+            [&latencyIntervalTxt] {
+                appAbort("invalid latency interval '",
+                         latencyIntervalTxt, "'");
+            },
+            [&latencyIntervalTxt] {
+                appAbort("invalid latency interval ", latencyIntervalTxt);
+            });
+    if (latencyInterval > 3'600)
+        appAbort("invalid latency interval ", latencyInterval);
+
+    return static_cast<unsigned>(latencyInterval);
+}
+
+unsigned getFlowCapacity(
+        bool flowCapacitySpecified, std::string const& flowCapacityTxt) {
+    if (! flowCapacitySpecified)
+        return 8;
+
+    auto flowCapacity = parseUInt64(flowCapacityTxt,
+            [&flowCapacityTxt] {
+                appAbort("invalid flow capacity '", flowCapacityTxt, "'");
+            },
+            [&flowCapacityTxt] {
+                appAbort("invalid flow capacity ", flowCapacityTxt);
+            });
+    if (flowCapacity == 0 || flowCapacity > 1'048'576)
+        appAbort("invalid flow capacity ", flowCapacity);
+
+    return static_cast<unsigned>(flowCapacity);
+}
+
+FanoutMode getFanout(bool fanoutSpecified, std::string const& fanoutTxt) {
+    if (! fanoutSpecified || fanoutTxt == "hash")
+        return FanoutMode::Hash;
+
+    if (fanoutTxt == "cpu")
+        return FanoutMode::Cpu;
+
+    if (fanoutTxt == "rr")
+        return FanoutMode::RoundRobin;
+
+    appAbort("invalid fanout mode '", fanoutTxt, "'");
+    return FanoutMode::Hash;
+}
+
+unsigned getInterval(
+        bool intervalSpecified, std::string const& intervalTxt) {
+    if (! intervalSpecified)
+        return 1000;
+
+    auto interval = parseUInt64(intervalTxt,
+            [&intervalTxt] {
+                appAbort("invalid interval '", intervalTxt, "'");
+            },
+            [&intervalTxt] {
+                appAbort("invalid interval ", intervalTxt);
+            });
+    if (interval == 0 || interval > 3'600'000)
+        appAbort("invalid interval ", interval);
+
+    return static_cast<unsigned>(interval);
+}
+
+PacingMode getPacing(bool pacingSpecified, std::string const& pacingTxt) {
+    if (! pacingSpecified || pacingTxt == "user")
+        return PacingMode::User;
+
+    if (pacingTxt == "txtime")
+        return PacingMode::TxTime;
+
+    if (pacingTxt == "max-rate")
+        return PacingMode::MaxRate;
+
+    appAbort("invalid pacing mode '", pacingTxt, "'");
+    return PacingMode::User;
+}
+
+unsigned getSize(std::string const& sizeTxt) {
+    auto size = parseUInt64(sizeTxt,
+            [&sizeTxt] {
+                appAbort("invalid beacon size '", sizeTxt, "'");
+            },
+            [&sizeTxt] {
+                appAbort("invalid beacon size ", sizeTxt);
+            });
+    if (size == 0 || size > MaxBeaconSize)
+        appAbort("invalid beacon size ", size);
+
+    return static_cast<unsigned>(size);
+}
+
+/**
+ * Parses the beacon sizes in the form N or N:W,N:W,... where W is the
+ * weight of the size in the mix, or the 'imix' mix
+ */
+std::vector<SizeWeight> getSizes(
+        bool sizesSpecified, std::string const& sizesTxt) {
+    std::vector<SizeWeight> sizes;
+    if (! sizesSpecified)
+        return sizes;
+
+    // The simple IMIX of the IP packets of 40, 576 and 1500 bytes, the
+    // smallest one is raised to hold the beacon
+    if (sizesTxt == "imix")
+        return {{64, 7}, {548, 4}, {1472, 1}};
+
+    std::string::size_type start{0};
+    while (start <= sizesTxt.length()) {
+        auto end = sizesTxt.find(',', start);
+        if (end == std::string::npos)
+            end = sizesTxt.length();
+
+        auto sizeTxt = sizesTxt.substr(start, end - start);
+        auto colonPos = sizeTxt.find(':');
+        SizeWeight sw{};
+        sw.size = getSize(sizeTxt.substr(0, colonPos));
+        sw.weight = 1;
+        if (colonPos != std::string::npos) {
+            auto weightTxt = sizeTxt.substr(colonPos + 1);
+            auto weight = parseUInt64(weightTxt,
+                    [&weightTxt] {
+                        appAbort("invalid size weight '", weightTxt, "'");
+                    },
+                    [&weightTxt] {
+                        appAbort("invalid size weight ", weightTxt);
+                    });
+            if (weight == 0 || weight > 1000)
+                appAbort("invalid size weight ", weight);
+            sw.weight = static_cast<unsigned>(weight);
+        }
+        sizes.push_back(sw);
+
+        start = end + 1;
+    }
+
+    if (sizes.size() > 64)
+        appAbort("too many beacon sizes, at most 64 are allowed");
+
+    return sizes;
+}
+
+/**
+ * Parses the rate in the form <N>[K|M|G][pps|bps], the multipliers are
+ * decimal and the rate is in packets per second unless bps is specified
+ */
+std::tuple<uint64_t, RateUnit> getRate(
+        bool rateSpecified, std::string const& rateTxt) {
+    if (! rateSpecified)
+        return std::make_tuple(0ul, RateUnit::Pps);
+
+    std::string numTxt = rateTxt;
+    auto unit = RateUnit::Pps;
+    auto endsWith = [&numTxt] (char const* suffix) {
+        std::size_t len = strlen(suffix);
+        return numTxt.size() > len
+                && numTxt.compare(numTxt.size() - len, len, suffix) == 0;
+    };
+    if (endsWith("bps")) {
+        unit = RateUnit::Bps;
+        numTxt.resize(numTxt.size() - 3);
+    } else if (endsWith("pps")) {
+        numTxt.resize(numTxt.size() - 3);
+    }
+
+    uint64_t mult{1};
+    if (! numTxt.empty()) {
+        switch (numTxt.back()) {
+        case 'K': case 'k': mult = 1'000; break;
+        case 'M': mult = 1'000'000; break;
+        case 'G': mult = 1'000'000'000; break;
+        default: break;
+        }
+        if (mult > 1)
+            numTxt.pop_back();
+    }
+
+    auto rate = parseUInt64(numTxt,
+            [&rateTxt] {
+                appAbort("invalid rate '", rateTxt, "'");
+            },
+            [&rateTxt] {
+                appAbort("invalid rate ", rateTxt);
+            });
+    // Up to 100 Mpps or 1 Tbps
+    uint64_t maxRate = unit == RateUnit::Pps
+            ? 100'000'000ul : 1'000'000'000'000ul;
+    if (rate == 0 || rate > maxRate / mult)
+        appAbort("invalid rate ", rateTxt);
+
+    return std::make_tuple(rate * mult, unit);
+}
+
+/**
+ * Parses the sender targets in the form G:P[@Rate], the flows without
+ * a rate are sent at the default rate. If there are several flows,
+ * each of them is paced, at one packet per second by default.
+ */
+std::vector<SenderFlow> senderFlows(
+        std::vector<std::string> const& targets,
+        bool portSpecified, std::string const& portTxt,
+        uint64_t rate, RateUnit rateUnit) {
+    if (targets.empty())
+        appAbort("no multicast target specified");
+
+    std::vector<SenderFlow> flows;
+    flows.reserve(targets.size());
+    for (auto const& target: targets) {
+        SenderFlow flow{};
+        flow.rate = rate;
+        flow.rateUnit = rateUnit;
+
+        auto at = target.find('@');
+        if (at != std::string::npos)
+            std::tie(flow.rate, flow.rateUnit) =
+                    getRate(true, target.substr(at + 1));
+
+        auto gp = groupPort(target.substr(0, at));
+        if (portSpecified && gp.portFound)
+            appAbort("option -p|--port may not be used if UDP port "
+                     "is specified in the target");
+        if (portSpecified)
+            gp.dport = getDPort(portTxt);
+        else if (gp.wildcard)
+            appAbort("the UDP port is required in the sender mode");
+
+        flow.group = gp.group;
+        flow.dport = gp.dport;
+        flows.push_back(flow);
+    }
+
+    if (flows.size() > 1) {
+        for (auto& flow: flows) {
+            if (flow.rate == 0) {
+                flow.rate = 1;
+                flow.rateUnit = RateUnit::Pps;
+            }
+        }
+    }
+
+    return flows;
+}
+
 } // anon.namespace
 
 Config Config::forArgs(int argc, char const* const* argv) {
-    std::string groupPortTxt;
+    std::vector<std::string> groupPortTxts;
     po::options_description groupPortOpts{"Group and optional port"};
     groupPortOpts.add_options()
             ("group",
-             po::value(&groupPortTxt)->value_name("<group[:port]>"));
+             po::value(&groupPortTxts)->value_name("<group[:port]>"));
 
+    std::string groupsFileTxt;
     std::string udpPortTxt;
     std::string intfTxt;
     std::string sourceTxt;
     std::string timeoutSecTxt;
     std::string ttlTxt;
     std::string countTxt;
+    std::string batchTxt;
+    std::string sportsTxt;
+    std::string budgetTxt;
+    std::string threadsTxt;
+    std::string cpusTxt;
+    std::string fanoutTxt;
+    std::string lineRateTxt;
+    std::string writeFile;
+    std::string writeSizeTxt;
+    std::string writeIntervalTxt;
+    std::string latencyIntervalTxt;
+    std::string flowCapacityTxt;
+    std::string readFile;
+    std::string rateTxt;
+    std::string pacingTxt;
+    std::string sizesTxt;
+    std::string intervalTxt;
     po::options_description generalOpts{"Options"};
     generalOpts.add_options()
             ("help,h", "Print usage and exit")
@@ -220,8 +750,16 @@ Config Config::forArgs(int argc, char const* const* argv) {
              "traffic destined for the group and all UDP ports. This "
              "operation requires the CAP_NET_RAW capability for the malt "
              "process.")
+            ("groups-file", po::value(&groupsFileTxt)->value_name("<File>"),
+             "Read the multicast targets from a file in addition to the "
+             "positional parameters. The file contains one target G or G:P "
+             "per line, the empty lines and the text following '#' are "
+             "ignored. Malt joins all the groups, reports the timeouts "
+             "and the stats per group. All the groups must be received "
+             "on the same UDP port or on all UDP ports.")
             ("intf,i", po::value(&intfTxt)->value_name("<Interface>"),
-             "Specify the multicast interface. This parameter is required")
+             "Specify the multicast interface. This parameter is required "
+             "unless --read is specified")
             ("source,s", po::value(&sourceTxt)->value_name("<Source-IP>"),
              "Specify the multicast source IP address. If this option is "
              "present, malt will perform IGMPv3 source specific (S,G) join "
@@ -230,6 +768,10 @@ Config Config::forArgs(int argc, char const* const* argv) {
              "IGMPv3 is disabled, the host will issue an IGMPv2 join for "
              "(*,G) and it will filter the other sources before letting "
              "malt see the traffic.")
+            ("sport", po::value(&sportsTxt)->value_name("<Ports>"),
+             "Accept only the packets sent from the specified UDP source "
+             "ports. The ports are specified as a comma separated list of "
+             "ports or port ranges, e.g. 10000-10099,12000.")
             ("timeout,t", po::value(&timeoutSecTxt)->value_name("<Timeout>"),
              "Specify a timeout in seconds for the received packets. "
              "If malt doesn't receive a packet in the specified number of "
@@ -240,16 +782,195 @@ Config Config::forArgs(int argc, char const* const* argv) {
              "Instead of subscribing to multicast, send multicast to the "
              "specified group and port. This option requires both a group "
              "and a UDP port to be specified. Malt will send one packet "
-             "per second.")
+             "per --interval unless --rate is specified. Several flows may be "
+             "specified as targets in the form G:P[@Rate], where Rate "
+             "overrides --rate for the flow. Each flow is paced on its "
+             "own, at one packet per second by default, and numbers its "
+             "packets on its own. The -c|--count option limits the "
+             "packets of each flow.")
             ("ttl", po::value(&ttlTxt)->value_name("<TTL>"),
              "If malt is sending, specify the TTL in the transmitted multicast "
              "packets. This option is available only if --sender is specified. "
              "Defaults to 255.")
+            ("interval", po::value(&intervalTxt)->value_name("<Msec>"),
+             "If malt is sending a single flow without --rate, send "
+             "a packet every specified number of milliseconds. The "
+             "packets are due at whole intervals from the start, thus "
+             "the period doesn't drift with the cost of the sending, and "
+             "the deadlines which pass before their packet can be sent "
+             "are skipped and reported. The valid values are in range "
+             "1-3600000. Defaults to 1000.")
+            ("rate", po::value(&rateTxt)->value_name("<Rate>"),
+             "If malt is sending, send the packets at the specified rate "
+             "in the form <N>[K|M|G][pps|bps], e.g. 100Kpps or 2Gbps, "
+             "the multipliers are decimal. The bit rate includes the "
+             "headers as in the received stats. Every flow keeps its own "
+             "schedule on a timer wheel, the packet k of a flow is due "
+             "k packet intervals after its start, thus the rate doesn't "
+             "drift with the cost of the sending. The packets due "
+             "together are sent in batches of up to --batch packets with "
+             "a single system call and the sent packets are not shown. "
+             "The packets of a flow falling more than 1 ms behind its "
+             "schedule are skipped and reported as missed deadlines. "
+             "This option is available only if --sender is specified.")
+            ("gso",
+             "If malt is sending paced flows, send the consecutive packets "
+             "of a flow in a batch as a single datagram which the kernel "
+             "segments into the packets with UDP GSO. This saves the "
+             "traversal of the stack per packet at high rates. If the host "
+             "doesn't support it, malt falls back to sending the packets "
+             "one by one.")
+            ("pacing", po::value(&pacingTxt)->value_name("<Mode>"),
+             "Specify how the paced packets are released at their due "
+             "time: 'user' sends every packet at its due time, 'txtime' "
+             "sends the packets up to 2 ms ahead with their due time "
+             "attached as SCM_TXTIME, which the fq qdisc of the "
+             "interface holds them until, and 'max-rate' sends the "
+             "packets up to 2 ms ahead and limits the socket to the rate "
+             "of its flows with SO_MAX_PACING_RATE, which the fq qdisc "
+             "enforces. Without such a qdisc the packets are sent early. "
+             "The kernel modes don't keep the sender spinning. Defaults "
+             "to user.")
+            ("size", po::value(&sizesTxt)->value_name("<Sizes>"),
+             "If malt is sending, pad the beacons to the specified UDP "
+             "payload size in bytes. A mix of sizes is specified as "
+             "a comma separated list of sizes with their weights, e.g. "
+             "64:7,548:4,1472:1, which is also available as 'imix'. The "
+             "sizes of a mix are interleaved in proportion to their "
+             "weights. The padding is derived from the sequence number "
+             "of the beacon and checked by the receivers in the captured "
+             "part of the payload. The sizes smaller than the beacon are "
+             "raised to its size. The valid sizes are in range 1-65507 "
+             "and the valid weights in range 1-1000.")
+            ("tx-timestamps",
+             "If malt is sending paced flows, ask the kernel for the time "
+             "every packet is passed to the device and report the offset "
+             "of the transmit times from the schedule of the packets.")
             ("data,d",
              "Show UDP payload data in hexadecimal and printable ASCII")
             ("count,c", po::value(&countTxt)->value_name("<Count>"),
              "Limit the number of received packets. Once the specified number "
              "of packets is received, malt terminates and prints the stats.")
+            ("batch", po::value(&batchTxt)->value_name("<Batch>"),
+             "Specify the maximum number of packets received with a single "
+             "system call, or sent with a single system call if --rate "
+             "is specified. The valid values are in range 1-1024. Larger "
+             "batches reduce the number of system calls at high packet "
+             "rates at the expense of memory. Defaults to 32.")
+            ("packet-ring",
+             "If the UDP port is not specified, receive the traffic "
+             "through a memory mapped AF_PACKET ring bound to the multicast "
+             "interface instead of a raw UDP socket. The packets are parsed "
+             "in place without a system call or a copy per packet, which "
+             "reduces the drops on busy hosts. This operation requires the "
+             "CAP_NET_RAW capability for the malt process.")
+            ("no-kernel-filter",
+             "If the UDP port is not specified, don't attach the filter "
+             "program to the socket, which discards the traffic not destined "
+             "for the group in the kernel. All the UDP traffic received by "
+             "the host is then filtered by malt. This is useful to measure "
+             "the traffic saved by the kernel filter.")
+            ("busy-poll",
+             "Instead of waiting for the packets, spin on the non-blocking "
+             "socket to reduce the receive latency. Malt also asks the "
+             "kernel to busy poll the device queue if the host allows it. "
+             "This mode keeps one CPU core fully busy.")
+            ("epoll-et",
+             "Register the socket with epoll in the edge triggered mode. "
+             "Malt always receives until the socket has no more data or "
+             "the budget is exhausted.")
+            ("budget", po::value(&budgetTxt)->value_name("<Budget>"),
+             "Specify the maximum number of packets received per epoll "
+             "wakeup. If the budget is exhausted, malt checks the timeout "
+             "and whether it was stopped before receiving the rest. The "
+             "valid values are in range 0-1000000, where 0 means no limit. "
+             "Defaults to 0.")
+            ("threads", po::value(&threadsTxt)->value_name("<Threads>"),
+             "Specify the number of the receiver threads. Each thread "
+             "receives from its own SO_REUSEPORT socket bound to the UDP "
+             "port and accepts only its share of the flows, which are "
+             "hashed by their source address and port in the kernel. "
+             "If the UDP port is not specified, this option requires "
+             "--packet-ring and each thread receives from its own packet "
+             "ring, the packets are spread across the rings by the kernel "
+             "according to --fanout. In the sender mode, the flows are "
+             "spread across the sender threads in a round robin fashion. "
+             "The valid values are in range 1-64. Defaults to 1.")
+            ("cpus", po::value(&cpusTxt)->value_name("<CPUs>"),
+             "Pin the receiver or sender threads to the specified CPUs in "
+             "a round robin fashion. The CPUs are specified as a comma "
+             "separated list of CPUs or CPU ranges, e.g. 2,4-7.")
+            ("fanout", po::value(&fanoutTxt)->value_name("<Mode>"),
+             "Specify how the packets are spread across the packet rings "
+             "of the receiver threads: 'hash' keeps the packets of a flow "
+             "in the same thread, 'cpu' keeps the packets received on "
+             "a CPU in the same thread and 'rr' spreads the packets in "
+             "a round robin fashion. The modes 'cpu' and 'rr' break up the "
+             "flows, thus the lost beacons are not tracked with them. This "
+             "option is available only with --packet-ring. Defaults to "
+             "hash.")
+            ("io-uring",
+             "If the UDP port is specified, receive the datagrams through "
+             "a multishot receive request of an io_uring instance into "
+             "the buffers provided to the kernel, which saves the system "
+             "call per batch. If the host doesn't support it, malt falls "
+             "back to recvmmsg().")
+            ("line-rate", po::value(&lineRateTxt)->value_name("<Rate>"),
+             "Specify the maximum number of the packet lines shown per "
+             "second. Once the packets arrive faster, malt shows a summary "
+             "line per flow every second instead, with the packet rate, "
+             "the bit rate, the average packet size and the TTL of the "
+             "flow. The packet lines are shown again once the packet rate "
+             "drops to the limit. With --read, the limit applies per second "
+             "of the capture. The valid values are in range "
+             "0-1000000, where 0 means no limit. Defaults to 0.")
+            ("latency-interval",
+             po::value(&latencyIntervalTxt)->value_name("<Seconds>"),
+             "Show the one-way latencies of the malt beacons received by "
+             "every flow in the last specified number of seconds, that is "
+             "the sample count, the minimum, the 50th, 90th, 99th and "
+             "99.9th percentiles and the maximum. The latencies of the "
+             "whole run are always reported at exit. The latencies are "
+             "only meaningful if the clocks of the hosts are synchronized. "
+             "The valid values are in range 0-3600, where 0 means that "
+             "the latencies are only reported at exit. Defaults to 0.")
+            ("flow-capacity",
+             po::value(&flowCapacityTxt)->value_name("<Flows>"),
+             "Specify the number of the flows each receiver thread makes "
+             "room for when a group receives its first packet. The flow "
+             "table doubles beyond it as needed, which rehashes the flows "
+             "received so far. A larger value only pays off when the "
+             "groups are joined without a source and receive from many "
+             "senders. The valid values are in range 1-1048576. "
+             "Defaults to 8.")
+            ("write", po::value(&writeFile)->value_name("<File>"),
+             "Write the accepted packets into the pcapng file with their "
+             "receive timestamps. The packets are written as raw IPv4 "
+             "packets and unless -d|--data is specified, only the "
+             "headers and the payload prefix needed to decode the malt "
+             "beacons are written. If there are several receiver threads, "
+             "each writes its own file named after the specified one with "
+             "the thread index inserted before the extension.")
+            ("write-size", po::value(&writeSizeTxt)->value_name("<MiB>"),
+             "Specify the size in MiB the capture files are preallocated "
+             "to. Once a file is full, a new file with the next sequence "
+             "number inserted before the extension is started. The valid "
+             "values are in range 1-4096. Defaults to 64.")
+            ("write-interval",
+             po::value(&writeIntervalTxt)->value_name("<Seconds>"),
+             "Start a new capture file once the specified number of "
+             "seconds has passed since the first packet of the current "
+             "file. The valid values are in range 0-86400, where 0 means "
+             "that a new file is only started once the current one is "
+             "full. Defaults to 0.")
+            ("read", po::value(&readFile)->value_name("<File>"),
+             "Instead of subscribing to multicast, replay the packets of "
+             "the pcap or pcapng file. The packets are filtered, shown "
+             "and accounted as if they were received, as fast as the file "
+             "is read, and the stats cover the time span of the capture. "
+             "The Ethernet, Linux cooked and raw IP captures are "
+             "supported. The options of the socket and the threads are "
+             "not available with this option.")
             ("nocolors",
              "Suppress colors in the output")
             ("version", "Print malt version and exit")
@@ -258,7 +979,7 @@ Config Config::forArgs(int argc, char const* const* argv) {
     po::options_description allOpts{"All"};
     allOpts.add(groupPortOpts).add(generalOpts);
     po::positional_options_description posParams;
-    posParams.add("group", 1);
+    posParams.add("group", -1);
 
     po::command_line_parser parser{argc, argv};
     parser.options(allOpts).positional(posParams);
@@ -273,14 +994,39 @@ Config Config::forArgs(int argc, char const* const* argv) {
 
     if (vm.count("help") > 0) {
         fmt::print(
-                "Usage: malt -i <intf> <group>[:<UDP port>]\n"
+                "Usage: malt -i <intf> <group>[:<UDP port>] ...\n"
+                "            [--groups-file <File>]\n"
                 "            [-p|--port <UDP port>]\n"
                 "            [-s|--source <Source-IP>]\n"
+                "            [--sport <Ports>]\n"
                 "            [-t|--timeout <Timeout>]\n"
                 "            [--sender]\n"
                 "            [--ttl <TTL>]\n"
+                "            [--interval <Msec>]\n"
+                "            [--rate <Rate>]\n"
+                "            [--gso]\n"
+                "            [--pacing <Mode>]\n"
+                "            [--tx-timestamps]\n"
+                "            [--size <Sizes>]\n"
                 "            [-d|--data]\n"
                 "            [-c|--cout <Count>]\n"
+                "            [--batch <Batch>]\n"
+                "            [--packet-ring]\n"
+                "            [--no-kernel-filter]\n"
+                "            [--busy-poll]\n"
+                "            [--epoll-et]\n"
+                "            [--budget <Budget>]\n"
+                "            [--threads <Threads>]\n"
+                "            [--cpus <CPUs>]\n"
+                "            [--fanout <Mode>]\n"
+                "            [--io-uring]\n"
+                "            [--line-rate <Rate>]\n"
+                "            [--latency-interval <Seconds>]\n"
+                "            [--flow-capacity <Flows>]\n"
+                "            [--write <File>]\n"
+                "            [--write-size <MiB>]\n"
+                "            [--write-interval <Seconds>]\n"
+                "            [--read <File>]\n"
                 "            [--nocolors]\n"
                 "            [--version]\n"
                 "            [--show-config]\n\n{}\n", generalOpts);
@@ -292,32 +1038,198 @@ Config Config::forArgs(int argc, char const* const* argv) {
         exit(0);
     }
 
-    auto gp = groupPort(
-            vm.count("group") > 0, groupPortTxt,
-            vm.count("port") > 0, udpPortTxt);
-    auto intfAddr = checkMCastIntf(vm.count("intf") > 0, intfTxt);
+    auto targets = readGroupsFile(
+            vm.count("groups-file") > 0, groupsFileTxt);
+    targets.insert(
+            targets.begin(), groupPortTxts.begin(), groupPortTxts.end());
+    bool sender;
+    unsigned ttl;
+    std::tie(sender, ttl) = getSenderParams(
+            vm.count("sender") > 0, vm.count("ttl") > 0, ttlTxt);
+    uint64_t rate;
+    RateUnit rateUnit;
+    std::tie(rate, rateUnit) = getRate(vm.count("rate") > 0, rateTxt);
+    if (! sender && rate > 0)
+        appAbort("--rate may only be used with --sender");
+
+    bool gso = vm.count("gso") > 0;
+    if (! sender && gso)
+        appAbort("--gso may only be used with --sender");
+
+    auto pacing = getPacing(vm.count("pacing") > 0, pacingTxt);
+    bool txTimestamps = vm.count("tx-timestamps") > 0;
+    if (! sender && (vm.count("pacing") > 0 || txTimestamps))
+        appAbort("--pacing and --tx-timestamps may only be used "
+                 "with --sender");
+
+    auto sizes = getSizes(vm.count("size") > 0, sizesTxt);
+    if (! sender && ! sizes.empty())
+        appAbort("--size may only be used with --sender");
+
+    auto intervalMs = getInterval(vm.count("interval") > 0, intervalTxt);
+    if (! sender && vm.count("interval") > 0)
+        appAbort("--interval may only be used with --sender");
+
+    std::vector<SenderFlow> flows;
+    GroupPorts gp{};
+    if (sender) {
+        flows = senderFlows(targets,
+                vm.count("port") > 0, udpPortTxt, rate, rateUnit);
+        for (auto const& flow: flows)
+            gp.groups.push_back(flow.group);
+        std::sort(gp.groups.begin(), gp.groups.end());
+        gp.groups.erase(
+                std::unique(gp.groups.begin(), gp.groups.end()),
+                gp.groups.end());
+        gp.dport = flows.front().dport;
+        gp.wildcard = false;
+    } else {
+        gp = groupPorts(targets, vm.count("port") > 0, udpPortTxt);
+    }
+    auto intfAddr = checkMCastIntf(
+            vm.count("intf") > 0, intfTxt, ! readFile.empty());
     auto sourceAddr = getSource(vm.count("source") > 0, sourceTxt);
     auto timeoutSec = getTimeout(vm.count("timeout") > 0, timeoutSecTxt);
     bool showPayload = vm.count("data") > 0;
     auto count = getCount(vm.count("count") > 0, countTxt);
+    auto batch = getBatch(vm.count("batch") > 0, batchTxt);
+    bool packetRing = vm.count("packet-ring") > 0;
+    auto sports = getSPorts(vm.count("sport") > 0, sportsTxt);
+    bool kernelFilter = vm.count("no-kernel-filter") == 0;
+    bool busyPoll = vm.count("busy-poll") > 0;
+    bool edgeTriggered = vm.count("epoll-et") > 0;
+    auto budget = getBudget(vm.count("budget") > 0, budgetTxt);
+    auto threads = getThreads(vm.count("threads") > 0, threadsTxt);
+    auto cpus = getCpus(vm.count("cpus") > 0, cpusTxt);
+    auto fanout = getFanout(vm.count("fanout") > 0, fanoutTxt);
+    bool ioUring = vm.count("io-uring") > 0;
+    auto lineRate = getLineRate(vm.count("line-rate") > 0, lineRateTxt);
+    auto latencyInterval = getLatencyInterval(
+            vm.count("latency-interval") > 0, latencyIntervalTxt);
+    auto flowCapacity = getFlowCapacity(
+            vm.count("flow-capacity") > 0, flowCapacityTxt);
+    auto writeSize = getWriteSize(vm.count("write-size") > 0, writeSizeTxt);
+    auto writeInterval = getWriteInterval(
+            vm.count("write-interval") > 0, writeIntervalTxt);
     bool nocolors = vm.count("nocolors") > 0 || !isatty(fileno(stdout));
-    bool sender;
-    unsigned ttl;
-    std::tie(sender, ttl) = getSenderParams(
-            vm.count("sender") > 0, vm.count("ttl") > 0, ttlTxt);
     if (sender) {
-        if (gp.wildcard)
-            appAbort("the UDP port is required in the sender mode");
+        // A single flow without a rate sends one packet per second
+        bool paced = flows.front().rate > 0;
         if (sourceAddr != net::IPv4Address{})
             appAbort("the source IP address may not be specified "
                      "in the sender mode");
 
         if (showPayload)
             appAbort("option -d|--data is not available in the sender mode");
+
+        if (vm.count("batch") > 0 && ! paced)
+            appAbort("option --batch requires --rate or several flows "
+                     "in the sender mode");
+
+        if (vm.count("interval") > 0 && paced)
+            appAbort("option --interval is not available with --rate "
+                     "or several flows");
+
+        if (gso && ! paced)
+            appAbort("option --gso requires --rate or several flows "
+                     "in the sender mode");
+
+        if ((vm.count("pacing") > 0 || txTimestamps) && ! paced)
+            appAbort("options --pacing and --tx-timestamps require "
+                     "--rate or several flows in the sender mode");
+
+        // The launch time would apply to all the segments
+        if (gso && pacing == PacingMode::TxTime)
+            appAbort("option --gso is not available with --pacing txtime");
+
+        if (packetRing)
+            appAbort("option --packet-ring is not available "
+                     "in the sender mode");
+
+        if (! sports.empty())
+            appAbort("option --sport is not available in the sender mode");
+
+        if (busyPoll)
+            appAbort("option --busy-poll is not available "
+                     "in the sender mode");
+
+        if (edgeTriggered || vm.count("budget") > 0)
+            appAbort("options --epoll-et and --budget are not available "
+                     "in the sender mode");
+
+        if ((threads > 1 || ! cpus.empty()) && ! paced)
+            appAbort("options --threads and --cpus require --rate or "
+                     "several flows in the sender mode");
+
+        if (threads > flows.size())
+            appAbort("option --threads exceeds the number of the flows "
+                     "in the sender mode");
+
+        if (ioUring)
+            appAbort("option --io-uring is not available in the sender mode");
+
+        if (lineRate > 0 || latencyInterval > 0)
+            appAbort("options --line-rate and --latency-interval are not "
+                     "available in the sender mode");
+
+        if (vm.count("flow-capacity") > 0)
+            appAbort("option --flow-capacity is not available "
+                     "in the sender mode");
+
+        if (! writeFile.empty())
+            appAbort("option --write is not available in the sender mode");
+
+        if (! readFile.empty())
+            appAbort("option --read is not available in the sender mode");
     }
 
+    if (! readFile.empty()) {
+        if (packetRing || ! kernelFilter)
+            appAbort("options --packet-ring and --no-kernel-filter "
+                     "are not available with --read");
+
+        if (busyPoll || edgeTriggered || vm.count("budget") > 0)
+            appAbort("options --busy-poll, --epoll-et and --budget "
+                     "are not available with --read");
+
+        if (threads > 1 || ! cpus.empty() || vm.count("fanout") > 0)
+            appAbort("options --threads, --cpus and --fanout "
+                     "are not available with --read");
+
+        if (ioUring)
+            appAbort("option --io-uring is not available with --read");
+
+        if (latencyInterval > 0)
+            appAbort("option --latency-interval is not available "
+                     "with --read");
+    }
+
+    if (threads > 1 && gp.wildcard && ! packetRing)
+        appAbort("option --threads requires either the UDP port "
+                 "or --packet-ring");
+
+    if (vm.count("fanout") > 0 && ! packetRing)
+        appAbort("option --fanout may only be used with --packet-ring");
+
+    if (packetRing && ! gp.wildcard)
+        appAbort("option --packet-ring may only be used if "
+                 "the UDP port is not specified");
+
+    if (writeFile.empty()
+        && (vm.count("write-size") > 0 || vm.count("write-interval") > 0))
+        appAbort("options --write-size and --write-interval may only be "
+                 "used with --write");
+
+    if (ioUring && gp.wildcard)
+        appAbort("option --io-uring may only be used if "
+                 "the UDP port is specified");
+
+    if (! kernelFilter && ! gp.wildcard)
+        appAbort("option --no-kernel-filter may only be used if "
+                 "the UDP port is not specified");
+
     Config cfg{
-        gp.group,
+        std::move(gp.groups),
         gp.dport,
         gp.wildcard,
         std::move(intfTxt),
@@ -328,7 +1240,33 @@ Config Config::forArgs(int argc, char const* const* argv) {
         ttl,
         count,
         showPayload,
-        ! nocolors
+        ! nocolors,
+        batch,
+        packetRing,
+        std::move(sports),
+        kernelFilter,
+        busyPoll,
+        edgeTriggered,
+        budget,
+        threads,
+        std::move(cpus),
+        fanout,
+        ioUring,
+        lineRate,
+        std::move(writeFile),
+        writeSize,
+        writeInterval,
+        std::move(readFile),
+        rate,
+        rateUnit,
+        std::move(flows),
+        gso,
+        pacing,
+        txTimestamps,
+        std::move(sizes),
+        intervalMs,
+        latencyInterval,
+        flowCapacity
     };
 
     if (vm.count("show-config") > 0)
@@ -339,6 +1277,19 @@ Config Config::forArgs(int argc, char const* const* argv) {
 
 namespace {
 
+std::string fmtGroups(std::vector<net::IPv4Address> const& groups) {
+    if (groups.size() > 8)
+        return fmt::format("{} groups, {} - {}",
+                groups.size(), groups.front(), groups.back());
+
+    fmt::memory_buffer buf;
+    for (auto group: groups) {
+        if (buf.size() > 0) fmt::format_to(buf, ", ");
+        fmt::format_to(buf, "{}", group);
+    }
+    return fmt::to_string(buf);
+}
+
 std::string fmtDPort(bool wildcard, uint16_t dport) {
     if (wildcard) return "*";
     return fmt::format("{}", dport);
@@ -354,6 +1305,100 @@ std::string fmtSender(bool sender, unsigned ttl) {
     return fmt::format("YES, TTL = {}", ttl);
 }
 
+std::string fmtSPorts(std::vector<PortRange> const& sports) {
+    if (sports.empty()) return "*";
+
+    fmt::memory_buffer buf;
+    for (auto const& r: sports) {
+        if (buf.size() > 0) fmt::format_to(buf, ",");
+        if (r.first == r.last) fmt::format_to(buf, "{}", r.first);
+        else fmt::format_to(buf, "{}-{}", r.first, r.last);
+    }
+    return fmt::to_string(buf);
+}
+
+std::string fmtCpus(std::vector<unsigned> const& cpus) {
+    if (cpus.empty()) return "any";
+
+    fmt::memory_buffer buf;
+    for (auto cpu: cpus) {
+        if (buf.size() > 0) fmt::format_to(buf, ",");
+        fmt::format_to(buf, "{}", cpu);
+    }
+    return fmt::to_string(buf);
+}
+
+std::string fmtFanout(FanoutMode fanout) {
+    switch (fanout) {
+    case FanoutMode::Hash: return "hash";
+    case FanoutMode::Cpu: return "cpu";
+    case FanoutMode::RoundRobin: return "rr";
+    }
+    return "?";
+}
+
+std::string fmtWriteFile(std::string const& writeFile) {
+    if (writeFile.empty()) return "none";
+    return writeFile;
+}
+
+std::string fmtReadFile(std::string const& readFile) {
+    if (readFile.empty()) return "none";
+    return readFile;
+}
+
+std::string fmtWriteInterval(unsigned writeInterval) {
+    if (writeInterval == 0) return "none";
+    return fmt::format("{} sec", writeInterval);
+}
+
+std::string fmtLatencyInterval(unsigned latencyInterval) {
+    if (latencyInterval == 0) return "none";
+    return fmt::format("{} sec", latencyInterval);
+}
+
+std::string fmtRate(uint64_t rate, RateUnit unit, unsigned intervalMs) {
+    if (rate == 0)
+        return fmt::format("1 packet per {} ms, not paced", intervalMs);
+    return fmt::format("{} {}", rate, unit == RateUnit::Pps ? "pps" : "bps");
+}
+
+std::string fmtFlows(std::vector<SenderFlow> const& flows) {
+    if (flows.empty()) return "none";
+    if (flows.size() > 8) return fmt::format("{}", flows.size());
+
+    fmt::memory_buffer buf;
+    for (auto const& flow: flows) {
+        if (buf.size() > 0) fmt::format_to(buf, ", ");
+        fmt::format_to(buf, "{}:{}", flow.group, flow.dport);
+        if (flow.rate > 0)
+            fmt::format_to(buf, "@{}{}", flow.rate,
+                    flow.rateUnit == RateUnit::Pps ? "pps" : "bps");
+    }
+    return fmt::to_string(buf);
+}
+
+std::string fmtPacing(PacingMode pacing) {
+    switch (pacing) {
+    case PacingMode::User: return "user";
+    case PacingMode::TxTime: return "txtime";
+    case PacingMode::MaxRate: return "max-rate";
+    }
+    return "?";
+}
+
+std::string fmtSizes(std::vector<SizeWeight> const& sizes) {
+    if (sizes.empty()) return "bare beacon";
+
+    fmt::memory_buffer buf;
+    for (auto const& sw: sizes) {
+        if (buf.size() > 0) fmt::format_to(buf, ",");
+        fmt::format_to(buf, "{}", sw.size);
+        if (sizes.size() > 1) fmt::format_to(buf, ":{}", sw.weight);
+    }
+    return fmt::to_string(buf);
+}
+
 std::string fmtCount(uint64_t count) {
     if (count == 0) return "unlimited";
     return fmt::format("{}", count);
@@ -363,15 +1408,40 @@ std::string fmtCount(uint64_t count) {
 
 std::string Config::str() const {
     ParamDescrList params{
-        formatParam("Group", group_),
+        formatParam("Groups", fmtGroups(groups_)),
         formatParam("UDP port", fmtDPort(wildcard_, dport_)),
         formatParam("Interface", intf_),
         formatParam("Interface IP address", intfAddr_),
         formatParam("Source", fmtSource(source_)),
+        formatParam("Source ports", fmtSPorts(sports_)),
         formatParam("Sender", fmtSender(sender_, ttl_)),
+        formatParam("Rate", fmtRate(rate_, rateUnit_, intervalMs_)),
+        formatParam("Flows", fmtFlows(flows_)),
+        formatParam("UDP GSO", gso_ ? "YES" : "NO"),
+        formatParam("Pacing", fmtPacing(pacing_)),
+        formatParam("TX timestamps", txTimestamps_ ? "YES" : "NO"),
+        formatParam("Beacon sizes", fmtSizes(sizes_)),
         formatParam("Count", fmtCount(count_)),
         formatParam("Show payload", showPayload_ ? "YES" : "NO"),
-        formatParam("Colors", colors_ ? "YES" : "NO")
+        formatParam("Colors", colors_ ? "YES" : "NO"),
+        formatParam("Batch", batch_),
+        formatParam("Packet ring", packetRing_ ? "YES" : "NO"),
+        formatParam("Kernel filter", kernelFilter_ ? "YES" : "NO"),
+        formatParam("Busy poll", busyPoll_ ? "YES" : "NO"),
+        formatParam("Edge triggered", edgeTriggered_ ? "YES" : "NO"),
+        formatParam("Budget", fmtCount(budget_)),
+        formatParam("Threads", threads_),
+        formatParam("CPUs", fmtCpus(cpus_)),
+        formatParam("Fanout", fmtFanout(fanout_)),
+        formatParam("io_uring", ioUring_ ? "YES" : "NO"),
+        formatParam("Line rate", fmtCount(lineRate_)),
+        formatParam("Latency interval", fmtLatencyInterval(latencyInterval_)),
+        formatParam("Flow capacity", flowCapacity_),
+        formatParam("Capture file", fmtWriteFile(writeFile_)),
+        formatParam("Capture file size", fmt::format("{} MiB",
+                writeSize_ >> 20u)),
+        formatParam("Capture file interval", fmtWriteInterval(writeInterval_)),
+        formatParam("Replayed file", fmtReadFile(readFile_))
     };
 
     return formatParams(params);
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include "vdunlib/net/IPv4Address.hpp"
 
@@ -9,8 +12,62 @@ using namespace vdunlib;
 
 namespace malt {
 
+struct PortRange final {
+    uint16_t first;
+    uint16_t last;
+};
+
+// How the packets are spread across the packet ring workers
+enum class FanoutMode {
+    // By the hash of the flow's addresses and ports
+    Hash,
+    // By the CPU the packet is received on
+    Cpu,
+    RoundRobin
+};
+
+// How the sender releases the packets at their due time
+enum class PacingMode {
+    // The sender sends every packet at its due time
+    User,
+    // The sender passes the due time of every packet to the kernel
+    // with SCM_TXTIME
+    TxTime,
+    // The sender sends the packets ahead and the kernel limits the
+    // rate of the socket with SO_MAX_PACING_RATE
+    MaxRate
+};
+
+// The unit of the sender rate
+enum class RateUnit {
+    // Packets per second
+    Pps,
+    // Bits per second including the headers as in FlowStats
+    Bps
+};
+
+// A flow of the sender
+struct SenderFlow final {
+    net::IPv4Address group;
+    uint16_t dport;
+    // The rate the flow is paced to in its unit, 0 if the only flow
+    // sends one packet per second without pacing
+    uint64_t rate;
+    RateUnit rateUnit;
+};
+
+// A beacon size of the sender and its share of the packets
+struct SizeWeight final {
+    unsigned size;
+    unsigned weight;
+};
+
 class Config final {
 public:
+    // The index returned by groupIndex() for the addresses which are
+    // not configured groups
+    static constexpr unsigned NoGroup{~0u};
+
     static Config forArgs(int argc, char const* const* argv);
 
     Config(Config const&) = delete;
@@ -18,7 +75,10 @@ public:
     Config& operator= (Config const&) = delete;
     Config& operator= (Config&&) noexcept = default;
 
-    net::IPv4Address group() const { return group_; }
+    // The groups are sorted and unique
+    std::vector<net::IPv4Address> const& groups() const { return groups_; }
+    // The first group, in the sender mode it is the only one
+    net::IPv4Address group() const { return groups_.front(); }
     uint16_t dport() const { return dport_; }
     bool wildcard() const { return wildcard_; }
     std::string const& intf() const { return intf_; }
@@ -30,10 +90,70 @@ public:
     unsigned ttl() const { return ttl_; }
     uint64_t count() const { return count_; }
     bool colors() const { return colors_; }
+    unsigned batch() const { return batch_; }
+    bool packetRing() const { return packetRing_; }
+    std::vector<PortRange> const& sports() const { return sports_; }
+    bool kernelFilter() const { return kernelFilter_; }
+    bool busyPoll() const { return busyPoll_; }
+    bool edgeTriggered() const { return edgeTriggered_; }
+    unsigned budget() const { return budget_; }
+    unsigned threads() const { return threads_; }
+    std::vector<unsigned> const& cpus() const { return cpus_; }
+    FanoutMode fanout() const { return fanout_; }
+    bool ioUring() const { return ioUring_; }
+    unsigned lineRate() const { return lineRate_; }
+    std::string const& writeFile() const { return writeFile_; }
+    std::size_t writeSize() const { return writeSize_; }
+    unsigned writeInterval() const { return writeInterval_; }
+    std::string const& readFile() const { return readFile_; }
+    uint64_t rate() const { return rate_; }
+    RateUnit rateUnit() const { return rateUnit_; }
+    // The flows in the order of the targets, only set in the sender mode
+    std::vector<SenderFlow> const& flows() const { return flows_; }
+    bool gso() const { return gso_; }
+    PacingMode pacing() const { return pacing_; }
+    bool txTimestamps() const { return txTimestamps_; }
+    std::vector<SizeWeight> const& sizes() const { return sizes_; }
+    unsigned intervalMs() const { return intervalMs_; }
+    unsigned latencyInterval() const { return latencyInterval_; }
+    unsigned flowCapacity() const { return flowCapacity_; }
+
+    bool sportAllowed(uint16_t sport) const {
+        if (sports_.empty()) return true;
+
+        for (auto const& r: sports_)
+            if (sport >= r.first && sport <= r.last) return true;
+
+        return false;
+    }
+
+    /**
+     * The sequence numbers are only tracked if each flow is received by
+     * a single thread, the fanout modes other than hash break up the
+     * flows.
+     */
+    bool seqTracking() const {
+        return ! packetRing_ || threads_ == 1 || fanout_ == FanoutMode::Hash;
+    }
+
+    /**
+     * @return the index of the group in groups() or NoGroup if the
+     * address is not a configured group
+     */
+    unsigned groupIndex(net::IPv4Address addr) const {
+        if (groups_.size() == 1)
+            return addr == groups_.front() ? 0 : NoGroup;
+
+        auto it = std::lower_bound(groups_.begin(), groups_.end(), addr);
+        if (it == groups_.end() || *it != addr)
+            return NoGroup;
+
+        return static_cast<unsigned>(it - groups_.begin());
+    }
 
     std::string str() const;
 private:
-    net::IPv4Address group_;
+    std::vector<net::IPv4Address> groups_;
     uint16_t dport_;
     bool wildcard_;
     std::string intf_;
@@ -47,8 +167,72 @@ private:
     uint64_t count_;
     bool showPayload_;
     bool colors_;
+    // The max number of datagrams received with a single system call
+    unsigned batch_;
+    // In the wildcard mode receive through an AF_PACKET ring
+    // instead of a raw UDP socket
+    bool packetRing_;
+    // If empty, the packets from all source ports are accepted
+    std::vector<PortRange> sports_;
+    // In the wildcard mode filter the packets in the kernel
+    bool kernelFilter_;
+    // Spin on the non-blocking socket instead of waiting on epoll
+    bool busyPoll_;
+    // Register the socket with epoll in the edge triggered mode
+    bool edgeTriggered_;
+    // The max number of packets received per epoll wakeup, 0 if the
+    // socket is always drained
+    unsigned budget_;
+    // The number of the receiver workers, each running in its own thread
+    unsigned threads_;
+    // The CPUs the workers are pinned to in a round robin fashion,
+    // if empty, the workers are not pinned
+    std::vector<unsigned> cpus_;
+    // In the packet ring mode spread the packets across the workers
+    // in this mode
+    FanoutMode fanout_;
+    // If the UDP port is specified, receive through an io_uring instance
+    // instead of recvmmsg()
+    bool ioUring_;
+    // The max number of the packet lines shown per second, above it
+    // the flows are summarized once per second, 0 if not limited
+    unsigned lineRate_;
+    // Write the accepted packets into pcapng files, if empty, the
+    // packets are not written
+    std::string writeFile_;
+    // The size in bytes each capture file is preallocated to
+    std::size_t writeSize_;
+    // Start a new capture file after this number of seconds, 0 if
+    // a new file is only started once the current one is full
+    unsigned writeInterval_;
+    // Replay the packets of the pcap or pcapng file instead of receiving
+    // them, if empty, the packets are received
+    std::string readFile_;
+    // The rate the sender paces the packets to, 0 if it sends one
+    // packet per second
+    uint64_t rate_;
+    RateUnit rateUnit_;
+    std::vector<SenderFlow> flows_;
+    // Send the consecutive packets of a flow as a single datagram
+    // segmented by the kernel
+    bool gso_;
+    PacingMode pacing_;
+    // Report the kernel transmit times of the paced packets against
+    // their schedule
+    bool txTimestamps_;
+    // The UDP payload sizes the beacons are padded to, if empty, the
+    // beacons are not padded
+    std::vector<SizeWeight> sizes_;
+    // The period of the sender which isn't paced
+    unsigned intervalMs_;
+    // Show the one-way latencies of the beacons received by every flow
+    // every this number of seconds, 0 if they are only reported at exit
+    unsigned latencyInterval_;
+    // The number of the flows each receiver thread makes room for when
+    // a group receives its first packet
+    unsigned flowCapacity_;
 
-    Config(net::IPv4Address group,
+    Config(std::vector<net::IPv4Address> groups,
            uint16_t dport,
            bool wildcard,
            std::string intf,
@@ -59,8 +243,34 @@ private:
            unsigned ttl,
            uint64_t count,
            bool showPayload,
-           bool colors)
-           : group_{group}
+           bool colors,
+           unsigned batch,
+           bool packetRing,
+           std::vector<PortRange> sports,
+           bool kernelFilter,
+           bool busyPoll,
+           bool edgeTriggered,
+           unsigned budget,
+           unsigned threads,
+           std::vector<unsigned> cpus,
+           FanoutMode fanout,
+           bool ioUring,
+           unsigned lineRate,
+           std::string writeFile,
+           std::size_t writeSize,
+           unsigned writeInterval,
+           std::string readFile,
+           uint64_t rate,
+           RateUnit rateUnit,
+           std::vector<SenderFlow> flows,
+           bool gso,
+           PacingMode pacing,
+           bool txTimestamps,
+           std::vector<SizeWeight> sizes,
+           unsigned intervalMs,
+           unsigned latencyInterval,
+           unsigned flowCapacity)
+           : groups_{std::move(groups)}
            , dport_{dport}
            , wildcard_{wildcard}
            , intf_{std::move(intf)}
@@ -71,7 +281,33 @@ private:
            , ttl_{ttl}
            , count_{count}
            , showPayload_{showPayload}
-           , colors_{colors} {}
+           , colors_{colors}
+           , batch_{batch}
+           , packetRing_{packetRing}
+           , sports_{std::move(sports)}
+           , kernelFilter_{kernelFilter}
+           , busyPoll_{busyPoll}
+           , edgeTriggered_{edgeTriggered}
+           , budget_{budget}
+           , threads_{threads}
+           , cpus_{std::move(cpus)}
+           , fanout_{fanout}
+           , ioUring_{ioUring}
+           , lineRate_{lineRate}
+           , writeFile_{std::move(writeFile)}
+           , writeSize_{writeSize}
+           , writeInterval_{writeInterval}
+           , readFile_{std::move(readFile)}
+           , rate_{rate}
+           , rateUnit_{rateUnit}
+           , flows_{std::move(flows)}
+           , gso_{gso}
+           , pacing_{pacing}
+           , txTimestamps_{txTimestamps}
+           , sizes_{std::move(sizes)}
+           , intervalMs_{intervalMs}
+           , latencyInterval_{latencyInterval}
+           , flowCapacity_{flowCapacity} {}
 };
 
 } // namespace malt
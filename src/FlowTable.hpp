@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace malt {
+
+/**
+ * An open addressing hash table of the values keyed by the flow ids.
+ * The values are stored inline in a dense array in the order they were
+ * inserted and the slots probed linearly only hold the keys and the
+ * indexes of the values, thus a lookup touches a couple of cache lines
+ * and an insert allocates nothing unless the table grows. Growing
+ * doubles the slots and rehashes the keys. The array of the values is
+ * reserved for the initial capacity, once the table outgrows it, the
+ * array grows geometrically and the values are moved. The capacity is
+ * meant to be small, thus the groups receiving from a few senders cost
+ * little memory. The values are never removed.
+ *
+ * The key UINT64_MAX marks an empty slot, it would be the flow of
+ * the broadcast source address, which never sends.
+ */
+template <typename Value>
+class FlowTable final {
+    static constexpr uint64_t EmptyKey{UINT64_MAX};
+
+    struct Slot final {
+        uint64_t key;
+        uint32_t index;
+    };
+
+public:
+    /**
+     * @param capacity the number of the values the table makes room
+     * for with the first insert
+     */
+    explicit FlowTable(std::size_t capacity)
+    : capacity_{capacity > 0 ? capacity : 1}, mask_{0}, shift_{64} {}
+
+    /**
+     * Constructs the value of the key from the arguments unless the key
+     * is already present. The pointer is valid until the next insert.
+     *
+     * @return the value of the key and true if it was inserted
+     */
+    template <typename... Args>
+    std::pair<Value*, bool> tryEmplace(uint64_t key, Args&&... args) {
+        if ((values_.size() + 1) * 2 > slots_.size())
+            grow();
+
+        for (uint64_t s = hash(key);; s = (s + 1) & mask_) {
+            Slot& slot = slots_[s];
+            if (slot.key == key)
+                return {&values_[slot.index], false};
+
+            if (slot.key == EmptyKey) {
+                slot.key = key;
+                slot.index = static_cast<uint32_t>(values_.size());
+                keys_.push_back(key);
+                values_.emplace_back(std::forward<Args>(args)...);
+                return {&values_.back(), true};
+            }
+        }
+    }
+
+    /**
+     * @return the value of the key or nullptr if it isn't present
+     */
+    Value const* find(uint64_t key) const {
+        if (slots_.empty())
+            return nullptr;
+
+        for (uint64_t s = hash(key);; s = (s + 1) & mask_) {
+            Slot const& slot = slots_[s];
+            if (slot.key == key)
+                return &values_[slot.index];
+
+            if (slot.key == EmptyKey)
+                return nullptr;
+        }
+    }
+
+    std::size_t size() const { return values_.size(); }
+
+    /**
+     * The keys and the values in the order they were inserted
+     */
+    uint64_t key(std::size_t i) const { return keys_[i]; }
+    Value& value(std::size_t i) { return values_[i]; }
+    Value const& value(std::size_t i) const { return values_[i]; }
+
+private:
+    std::size_t const capacity_;
+    uint64_t mask_;
+    unsigned shift_;
+    // At most half of the slots are occupied
+    std::vector<Slot> slots_;
+    std::vector<uint64_t> keys_;
+    std::vector<Value> values_;
+
+    /**
+     * Fibonacci hashing spreads the flow ids differing only in their
+     * low bits over the whole table
+     */
+    uint64_t hash(uint64_t key) const {
+        return (key * 0x9e3779b97f4a7c15ul) >> shift_;
+    }
+
+    void grow() {
+        std::size_t slots{2};
+        shift_ = 63;
+        while (slots < 2 * std::max(capacity_, values_.size() + 1)) {
+            slots <<= 1u;
+            --shift_;
+        }
+        mask_ = slots - 1;
+
+        if (values_.empty()) {
+            keys_.reserve(capacity_);
+            values_.reserve(capacity_);
+        }
+
+        slots_.assign(slots, Slot{EmptyKey, 0});
+        for (std::size_t i{0}; i < keys_.size(); ++i) {
+            uint64_t s = hash(keys_[i]);
+            while (slots_[s].key != EmptyKey)
+                s = (s + 1) & mask_;
+            slots_[s] = Slot{keys_[i], static_cast<uint32_t>(i)};
+        }
+    }
+};
+
+} // namespace malt
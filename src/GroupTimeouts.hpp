@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "vdunlib/time/Time.hpp"
+
+#include "Config.hpp"
+
+namespace malt {
+
+/**
+ * This class facilitates timeout reporting. If we were only to
+ * open a regular socket then we could use the timeout parameter
+ * of the epoll_wait call to report timeouts. This unfortunately
+ * won't work in case we open a raw UDP socket because then we
+ * receive all UDP traffic destined for the host, thus we need to
+ * accept only the multicast packets we're interested in.
+ *
+ * Every configured group has a counter which is reset to the kernel
+ * receive time of its packets, thus the host clock is only read when
+ * malt needs to check for a timeout without having received a packet.
+ *
+ * The counters are shared by all the receiver workers, which reset
+ * them, while only one of the workers checks them. The counters are
+ * only scanned once the earliest deadline found by the previous scan
+ * has passed, thus checking for the timeouts costs a single comparison
+ * with the host time no matter how many groups are received.
+ * Resetting a counter only moves its deadline later, which keeps the
+ * saved deadline a lower bound of the actual one.
+ */
+class GroupTimeouts final {
+    // The workers receiving the same group don't write its counter
+    // more often than this, which keeps the counter's cache line from
+    // bouncing between the cores for every packet
+    static constexpr uint64_t ResetGranularityNs{1'000'000};
+
+public:
+    explicit GroupTimeouts(Config const& cfg)
+    : startNs_{new std::atomic<uint64_t>[cfg.groups().size()]}
+    , size_{static_cast<unsigned>(cfg.groups().size())}
+    , timeoutNs_{static_cast<uint64_t>(cfg.timeoutSec()) * 1'000'000'000}
+    , nextScanNs_{0} {
+        uint64_t hostNs = TimeUtils::gethostnanos();
+        for (unsigned g{0}; g < size_; ++g)
+            startNs_[g].store(hostNs, std::memory_order_relaxed);
+    }
+
+    /**
+     * Resets the counter of the group to the receive time of a packet.
+     * This function may be called by any worker.
+     */
+    void reset(unsigned group, uint64_t pktTs) {
+        auto& startNs = startNs_[group];
+        if (pktTs > startNs.load(std::memory_order_relaxed)
+                    + ResetGranularityNs)
+            startNs.store(pktTs, std::memory_order_relaxed);
+    }
+
+    /**
+     * Calls report(group, hostNs) for every group whose timeout has
+     * expired at the host time and resets its counter. This function
+     * may only be called by one worker.
+     */
+    template <typename Report>
+    void check(uint64_t hostNs, Report&& report) {
+        if (timeoutNs_ == 0 || hostNs < nextScanNs_) return;
+
+        nextScanNs_ = ~0ul;
+        for (unsigned g{0}; g < size_; ++g) {
+            uint64_t startNs = startNs_[g].load(std::memory_order_relaxed);
+            // The host clock may have been stepped back
+            if (hostNs > startNs && hostNs - startNs >= timeoutNs_) {
+                report(g, hostNs);
+                // A worker may have received a packet in the meantime
+                if (startNs_[g].compare_exchange_strong(
+                        startNs, hostNs, std::memory_order_relaxed))
+                    startNs = hostNs;
+            }
+            nextScanNs_ = std::min(nextScanNs_, startNs + timeoutNs_);
+        }
+    }
+
+private:
+    std::unique_ptr<std::atomic<uint64_t>[]> startNs_;
+    unsigned size_;
+    uint64_t const timeoutNs_;
+    uint64_t nextScanNs_;
+};
+
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <linux/ip.h>
+#include <linux/udp.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "vdunlib/net/IPv4Address.hpp"
+
+#include "PacketInfo.hpp"
+#include "AppUtils.hpp"
+#include "Config.hpp"
+
+namespace malt {
+
+/**
+ * Parses a UDP datagram starting with its IPv4 header and fills in
+ * the packet info. The payload of the packet info points into the
+ * parsed buffer, thus it is valid only as long as the buffer is.
+ * The buffer may hold only the beginning of the packet, in which
+ * case only the captured part of the payload is available.
+ *
+ * @param buf the received data starting with the IPv4 header
+ * @param capturedSize the number of bytes available in the buffer
+ * @param rcvSize the size of the received packet
+ * @param cfg the config specifying the groups, the source and the
+ * source ports of the accepted packets
+ * @param pinfo the packet info to fill in
+ * @param pktTs the timestamp used for the warnings
+ * @return Accepted if the packet is a UDP datagram destined for one
+ * of the groups and sent from the configured source and source ports,
+ * Filtered otherwise
+ */
+inline ReceivedPacket parseIPv4Udp(
+        uint8_t const* buf, std::size_t capturedSize, std::size_t rcvSize,
+        Config const& cfg, PacketInfo& pinfo, uint64_t pktTs) {
+    // Make sure the IP header fits into the received packet data,
+    // but this should never fail
+    if (capturedSize < sizeof(iphdr)) {
+        warningTs(pktTs,
+                "received packet size ", capturedSize,
+                " is smaller than the minimal IP header size (",
+                sizeof(iphdr), ")");
+        return ReceivedPacket::Filtered;
+    }
+    auto ipHdr = reinterpret_cast<iphdr const*>(buf);
+
+    // Make sure this packet is a UDP datagram destined for a multicast
+    // group we're interested in
+    if (ipHdr->protocol != IPPROTO_UDP)
+        return ReceivedPacket::Filtered;
+
+    auto group = net::IPv4Address::from_nl(ipHdr->daddr);
+    auto groupIndex = cfg.groupIndex(group);
+    if (groupIndex == Config::NoGroup)
+        return ReceivedPacket::Filtered;
+
+    if (cfg.source() != net::IPv4Address{}
+        && ipHdr->saddr != cfg.source().to_nl())
+        return ReceivedPacket::Filtered;
+
+    auto ipHdrLen = static_cast<uint16_t>(ipHdr->ihl) << 2u;
+    auto udpPayloadOffset = ipHdrLen + sizeof(udphdr);
+    // Make sure there is enough room for the UDP header and payload
+    if (udpPayloadOffset > capturedSize) {
+        warningTs(pktTs,
+                "UDP payload offset ", udpPayloadOffset,
+                " is outside of the received packet size ", capturedSize,
+                " (IP header len = ", ipHdrLen, ")");
+        return ReceivedPacket::Filtered;
+    }
+
+    pinfo.group = group;
+    pinfo.groupIndex = groupIndex;
+    pinfo.source = net::IPv4Address::from_nl(ipHdr->saddr);
+    pinfo.ttl = static_cast<int16_t>(ipHdr->ttl);
+
+    auto udpHdr = reinterpret_cast<udphdr const*>(buf + ipHdrLen);
+    pinfo.sport = ntohs(udpHdr->source);
+    if (! cfg.sportAllowed(pinfo.sport))
+        return ReceivedPacket::Filtered;
+
+    pinfo.dport = ntohs(udpHdr->dest);
+    // This value maybe 0
+    pinfo.payloadSize =
+            static_cast<size_t>(ntohs(udpHdr->len)) - sizeof(udphdr);
+
+    // This is a sanity check for the received size vs the UDP
+    // payload size in the UDP header
+    if (udpPayloadOffset + pinfo.payloadSize != rcvSize) {
+        if (udpPayloadOffset + pinfo.payloadSize < rcvSize) {
+            warningTs(pktTs,
+                    "UDP datagram ", pinfo.source, ':',
+                    pinfo.sport, " -> ",
+                    pinfo.group, ':', pinfo.dport,
+                    " has extraneous bytes (recv size = ",
+                    rcvSize - udpPayloadOffset,
+                    ", UDP size = ", pinfo.payloadSize, ')');
+        } else {
+            warningTs(pktTs,
+                    "size of UDP datagram ", pinfo.source, ':',
+                    pinfo.sport, " -> ",
+                    pinfo.group, ':', pinfo.dport,
+                    " is not suffient for UDP payload (recv size = ",
+                    rcvSize - udpPayloadOffset,
+                    ", UDP size = ", pinfo.payloadSize, ')');
+            pinfo.payloadSize = rcvSize - udpPayloadOffset;
+        }
+    }
+
+    pinfo.payload = buf + udpPayloadOffset;
+    pinfo.capturedSize = std::min(
+            pinfo.payloadSize,
+            static_cast<unsigned>(capturedSize - udpPayloadOffset));
+    return ReceivedPacket::Accepted;
+}
+
+} // namespace malt
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace malt {
+
+/**
+ * A minimal io_uring instance set up with the raw system calls. It only
+ * supports what the io_uring receiver policy needs: submitting one SQE
+ * at a time, reaping the CQEs and registering a provided buffer ring.
+ * The SQEs and the CQEs are only accessed by the thread which owns
+ * the instance, the kernel is synchronized with through the acquire
+ * loads and the release stores of the ring heads and tails.
+ */
+class IoUring final {
+public:
+    IoUring()
+    : fd_{-1}, sqRing_{nullptr}, sqRingSize_{0}, cqRing_{nullptr}
+    , cqRingSize_{0}, sqes_{nullptr}, sqesSize_{0}, params_{} {}
+
+    IoUring(IoUring const&) = delete;
+    IoUring& operator= (IoUring const&) = delete;
+
+    ~IoUring() {
+        if (sqes_ != nullptr)
+            munmap(sqes_, sqesSize_);
+        if (cqRing_ != nullptr && cqRing_ != sqRing_)
+            munmap(cqRing_, cqRingSize_);
+        if (sqRing_ != nullptr)
+            munmap(sqRing_, sqRingSize_);
+
+        if (fd_ != -1) {
+            int rc;
+            do {
+                rc = close(fd_);
+            } while (rc == -1 && errno == EINTR);
+        }
+    }
+
+    /**
+     * Sets up the instance and maps its rings.
+     *
+     * @return true on success, false otherwise with errno set
+     */
+    bool init(unsigned sqEntries, unsigned cqEntries) {
+        params_.flags = IORING_SETUP_CQSIZE;
+        params_.cq_entries = cqEntries;
+        fd_ = static_cast<int>(
+                syscall(__NR_io_uring_setup, sqEntries, &params_));
+        if (fd_ == -1)
+            return false;
+
+        sqRingSize_ = params_.sq_off.array
+                      + params_.sq_entries * sizeof(uint32_t);
+        cqRingSize_ = params_.cq_off.cqes
+                      + params_.cq_entries * sizeof(io_uring_cqe);
+        bool singleMmap = (params_.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap)
+            sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+
+        sqRing_ = map(sqRingSize_, IORING_OFF_SQ_RING);
+        if (sqRing_ == nullptr)
+            return false;
+
+        cqRing_ = singleMmap ? sqRing_ : map(cqRingSize_, IORING_OFF_CQ_RING);
+        if (cqRing_ == nullptr)
+            return false;
+
+        sqesSize_ = params_.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(map(sqesSize_, IORING_OFF_SQES));
+        return sqes_ != nullptr;
+    }
+
+    int fd() const { return fd_; }
+
+    /**
+     * Registers a ring of the buffers the kernel picks from for
+     * the requests selecting a buffer of the group.
+     *
+     * @return true on success, false otherwise with errno set
+     */
+    bool registerBufRing(
+            io_uring_buf_ring* bufRing, unsigned entries, uint16_t bgid) {
+        io_uring_buf_reg reg{};
+        reg.ring_addr = reinterpret_cast<uint64_t>(bufRing);
+        reg.ring_entries = entries;
+        reg.bgid = bgid;
+
+        return syscall(__NR_io_uring_register,
+                fd_, IORING_REGISTER_PBUF_RING, &reg, 1) == 0;
+    }
+
+    /**
+     * Submits a single SQE prepared by the function passed in.
+     *
+     * @return true on success, false otherwise with errno set
+     */
+    template <typename Prepare>
+    bool submit(Prepare&& prepare) {
+        uint32_t tail = *sqTail();
+        uint32_t idx = tail & *sqMask();
+        io_uring_sqe* sqe = &sqes_[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        prepare(*sqe);
+        sqArray()[idx] = idx;
+        __atomic_store_n(sqTail(), tail + 1, __ATOMIC_RELEASE);
+
+        long rc;
+        do {
+            rc = syscall(__NR_io_uring_enter, fd_, 1, 0, 0, nullptr, 0);
+        } while (rc == -1 && errno == EINTR);
+
+        return rc == 1;
+    }
+
+    /**
+     * Passes up to max available CQEs to the consumer and returns them
+     * to the kernel.
+     *
+     * @return the number of the reaped CQEs
+     */
+    template <typename Consumer>
+    unsigned reap(unsigned max, Consumer&& consume) {
+        uint32_t head = *cqHead();
+        uint32_t tail = __atomic_load_n(cqTail(), __ATOMIC_ACQUIRE);
+        unsigned n{0};
+        for (; head != tail && n < max; ++head, ++n)
+            consume(cqes()[head & *cqMask()]);
+
+        __atomic_store_n(cqHead(), head, __ATOMIC_RELEASE);
+        return n;
+    }
+
+    /**
+     * Moves the CQEs the kernel kept aside when the completion queue
+     * was full into the queue
+     */
+    void flushOverflow() {
+        if ((__atomic_load_n(sqFlags(), __ATOMIC_RELAXED)
+             & IORING_SQ_CQ_OVERFLOW) == 0)
+            return;
+
+        syscall(__NR_io_uring_enter,
+                fd_, 0, 0, IORING_ENTER_GETEVENTS, nullptr, 0);
+    }
+
+private:
+    int fd_;
+    void* sqRing_;
+    std::size_t sqRingSize_;
+    void* cqRing_;
+    std::size_t cqRingSize_;
+    io_uring_sqe* sqes_;
+    std::size_t sqesSize_;
+    io_uring_params params_;
+
+    void* map(std::size_t size, uint64_t offset) const {
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd_,
+                       static_cast<off_t>(offset));
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    uint32_t* sqField(uint32_t offset) const {
+        return reinterpret_cast<uint32_t*>(
+                static_cast<uint8_t*>(sqRing_) + offset);
+    }
+
+    uint32_t* cqField(uint32_t offset) const {
+        return reinterpret_cast<uint32_t*>(
+                static_cast<uint8_t*>(cqRing_) + offset);
+    }
+
+    uint32_t* sqTail() const { return sqField(params_.sq_off.tail); }
+    uint32_t* sqMask() const { return sqField(params_.sq_off.ring_mask); }
+    uint32_t* sqFlags() const { return sqField(params_.sq_off.flags); }
+    uint32_t* sqArray() const { return sqField(params_.sq_off.array); }
+    uint32_t* cqHead() const { return cqField(params_.cq_off.head); }
+    uint32_t* cqTail() const { return cqField(params_.cq_off.tail); }
+    uint32_t* cqMask() const { return cqField(params_.cq_off.ring_mask); }
+
+    io_uring_cqe* cqes() const {
+        return reinterpret_cast<io_uring_cqe*>(
+                static_cast<uint8_t*>(cqRing_) + params_.cq_off.cqes);
+    }
+};
+
+/**
+ * A ring of equally sized buffers provided to an io_uring instance.
+ * The kernel consumes the buffers in the order they were added and
+ * reports the id of the buffer it received into with each completion.
+ * The buffers are added back once their contents have been processed.
+ */
+class ProvidedBuffers final {
+public:
+    ProvidedBuffers(unsigned count, unsigned size)
+    : count_{count}, size_{size}
+    , ringSize_{count * sizeof(io_uring_buf)}
+    , ring_{nullptr}, bufs_(static_cast<std::size_t>(count) * size)
+    , tail_{0} {}
+
+    ProvidedBuffers(ProvidedBuffers const&) = delete;
+    ProvidedBuffers& operator= (ProvidedBuffers const&) = delete;
+
+    ~ProvidedBuffers() {
+        if (ring_ != nullptr)
+            munmap(ring_, ringSize_);
+    }
+
+    /**
+     * Registers the buffers as the group bgid of the io_uring instance
+     * and provides all of them.
+     *
+     * @return true on success, false otherwise with errno set
+     */
+    bool registerWith(IoUring& ring, uint16_t bgid) {
+        void* p = mmap(nullptr, ringSize_, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return false;
+
+        ring_ = static_cast<io_uring_buf_ring*>(p);
+        if (! ring.registerBufRing(ring_, count_, bgid))
+            return false;
+
+        for (uint16_t bid{0}; bid < count_; ++bid)
+            add(bid);
+        commit();
+        return true;
+    }
+
+    uint8_t* data(uint16_t bid) {
+        return bufs_.data() + static_cast<std::size_t>(bid) * size_;
+    }
+
+    unsigned size() const { return size_; }
+
+    /**
+     * Queues the buffer to be provided again on the next commit
+     */
+    void add(uint16_t bid) {
+        // Not ring_->bufs, in C++ the flexible array of the kernel header
+        // is placed after an empty struct, which takes up space
+        io_uring_buf& buf =
+                reinterpret_cast<io_uring_buf*>(ring_)[tail_ & (count_ - 1)];
+        buf.addr = reinterpret_cast<uint64_t>(data(bid));
+        buf.len = size_;
+        buf.bid = bid;
+        ++tail_;
+    }
+
+    /**
+     * Makes the buffers added since the last commit visible to
+     * the kernel
+     */
+    void commit() {
+        __atomic_store_n(&ring_->tail, tail_, __ATOMIC_RELEASE);
+    }
+
+private:
+    unsigned const count_;
+    unsigned const size_;
+    std::size_t const ringSize_;
+    io_uring_buf_ring* ring_;
+    std::vector<uint8_t> bufs_;
+    uint16_t tail_;
+};
+
+} // namespace malt
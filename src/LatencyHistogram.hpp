@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace malt {
+
+/**
+ * A log-linear histogram of latencies in nanoseconds in the style of
+ * HdrHistogram. The values below 2^SubBucketBits have a bucket each and
+ * every following power of 2 range is split into 2^SubBucketBits equal
+ * buckets, thus a bucket is never wider than about 3% of its values.
+ * Recording a value takes constant time. The buckets are allocated with
+ * the first value, thus the flows carrying no beacons cost no memory.
+ *
+ * The negative latencies of the hosts whose clocks are not synchronized
+ * are counted in the first bucket, but the minimum and the maximum are
+ * exact. The values above the range are counted in the last bucket.
+ */
+class LatencyHistogram final {
+    static constexpr unsigned SubBucketBits{5};
+    static constexpr uint64_t SubBuckets{1ul << SubBucketBits};
+    // The range of the buckets, about 68 seconds
+    static constexpr unsigned MaxBits{36};
+    static constexpr std::size_t Buckets{
+            (MaxBits - SubBucketBits + 1) * SubBuckets};
+
+public:
+    void record(int64_t ns) {
+        if (counts_.empty())
+            counts_.resize(Buckets, 0);
+
+        if (count_ == 0 || ns < min_) min_ = ns;
+        if (count_ == 0 || ns > max_) max_ = ns;
+        ++count_;
+        ++counts_[bucket(ns)];
+    }
+
+    void merge(LatencyHistogram const& lh) {
+        if (lh.count_ == 0)
+            return;
+
+        if (counts_.empty())
+            counts_.resize(Buckets, 0);
+
+        for (std::size_t b{0}; b < Buckets; ++b)
+            counts_[b] += lh.counts_[b];
+        min_ = count_ == 0 ? lh.min_ : std::min(min_, lh.min_);
+        max_ = count_ == 0 ? lh.max_ : std::max(max_, lh.max_);
+        count_ += lh.count_;
+    }
+
+    /**
+     * Forgets the values, but keeps the buckets allocated
+     */
+    void reset() {
+        std::fill(counts_.begin(), counts_.end(), 0);
+        count_ = 0;
+    }
+
+    uint64_t count() const { return count_; }
+
+    // Only valid if there are any values
+    int64_t min() const { return min_; }
+    int64_t max() const { return max_; }
+
+    /**
+     * @return the highest value of the bucket holding the percentile,
+     * limited by the minimum and the maximum
+     */
+    int64_t percentile(double pct) const {
+        auto rank = static_cast<uint64_t>(
+                std::ceil(pct / 100 * static_cast<double>(count_)));
+        rank = std::max<uint64_t>(rank, 1);
+        uint64_t seen{0};
+        for (std::size_t b{0}; b < Buckets; ++b) {
+            seen += counts_[b];
+            if (seen >= rank && b < Buckets - 1)
+                return std::max(min_, std::min(max_, highestValue(b)));
+        }
+        return max_;
+    }
+
+private:
+    std::vector<uint64_t> counts_;
+    uint64_t count_{0};
+    int64_t min_{0};
+    int64_t max_{0};
+
+    static std::size_t bucket(int64_t ns) {
+        if (ns < static_cast<int64_t>(SubBuckets))
+            return ns < 0 ? 0 : static_cast<std::size_t>(ns);
+
+        auto v = static_cast<uint64_t>(ns);
+        auto msb = static_cast<unsigned>(63 - __builtin_clzl(v));
+        if (msb >= MaxBits)
+            return Buckets - 1;
+
+        // The range of the msb has the SubBuckets buckets following
+        // the buckets of the lower ranges
+        unsigned shift = msb - SubBucketBits;
+        return (shift + 1) * SubBuckets + ((v >> shift) - SubBuckets);
+    }
+
+    static int64_t highestValue(std::size_t b) {
+        if (b < SubBuckets)
+            return static_cast<int64_t>(b);
+
+        uint64_t shift = b / SubBuckets - 1;
+        uint64_t sub = b % SubBuckets + SubBuckets;
+        return static_cast<int64_t>(((sub + 1) << shift) - 1);
+    }
+};
+
+} // namespace malt
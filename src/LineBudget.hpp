@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "vdunlib/net/IPv4Address.hpp"
+
+#include "RxStats.hpp"
+
+namespace malt {
+
+/**
+ * Limits the packet lines shown per display interval of a second. Once
+ * the budget of an interval is exhausted, the remaining packets of the
+ * interval are not shown and every flow which received packets in the
+ * interval is summarized at its end instead. The next interval is only
+ * summarized unless the packet rate drops to the budget.
+ *
+ * The intervals are timed by the caller, the receivers use the host
+ * clock and the replay the timestamps of the capture.
+ */
+class LineBudget final {
+    static constexpr uint64_t IntervalNs{1'000'000'000};
+
+public:
+    LineBudget(unsigned lines, uint64_t startNs)
+    : lines_{lines}
+    , linesLeft_{lines}
+    , pkts_{0}
+    , startNs_{startNs}
+    , summarize_{false} {}
+
+    /**
+     * @return true if the line of the packet may be shown
+     */
+    bool takeLine() {
+        ++pkts_;
+        if (linesLeft_ == 0) {
+            summarize_ = true;
+            return false;
+        }
+
+        --linesLeft_;
+        return true;
+    }
+
+    /**
+     * Ends the interval if it has passed at the time
+     */
+    template <typename Consumer>
+    void check(uint64_t nowNs, std::vector<net::IPv4Address> const& groups,
+               RxStats& rxStats, Consumer&& consume) {
+        if (nowNs >= startNs_ + IntervalNs)
+            end(nowNs, groups, rxStats, consume);
+    }
+
+    /**
+     * Ends the interval at the time and passes the summaries of its
+     * flows to the consumer if the budget was exhausted
+     */
+    template <typename Consumer>
+    void end(uint64_t nowNs, std::vector<net::IPv4Address> const& groups,
+             RxStats& rxStats, Consumer&& consume) {
+        for (unsigned g{0}; g < groups.size(); ++g) {
+            rxStats.group(g).forEachInInterval(
+                    [&] (auto source, auto sport, auto dport,
+                         FlowStats const& fs) {
+                if (! summarize_) return;
+
+                FlowSummary summary{};
+                summary.timestamp = nowNs;
+                summary.durationNanos = nowNs - startNs_;
+                summary.source = source;
+                summary.sport = sport;
+                summary.group = groups[g];
+                summary.dport = dport;
+                summary.ttl = fs.ttl();
+                summary.pkts = fs.intervalPkts();
+                summary.bytes = fs.intervalBytes();
+                consume(summary);
+            });
+        }
+
+        summarize_ = pkts_ > lines_;
+        linesLeft_ = summarize_ ? 0 : lines_;
+        pkts_ = 0;
+        startNs_ = nowNs;
+    }
+
+private:
+    unsigned const lines_;
+    unsigned linesLeft_;
+    // The packets of the interval, shown or not
+    uint64_t pkts_;
+    uint64_t startNs_;
+    // The flows of the current interval are summarized at its end
+    bool summarize_;
+};
+
+} // namespace malt
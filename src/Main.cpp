@@ -6,7 +6,8 @@
 
 namespace malt {
 namespace {
-bool stopped{false};
+// Setting a lock-free atomic is safe in a signal handler
+StopFlag stopped{false};
 } // anon.namespace
 } // namespace malt
 
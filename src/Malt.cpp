@@ -5,19 +5,38 @@
 #include "Malt.hpp"
 #include "MaltSender.hpp"
 #include "MaltReceiver.hpp"
+#include "MaltReplay.hpp"
+#include "ReceiverPolicyPacketRing.hpp"
 #include "ReceiverPolicyRaw.hpp"
 #include "ReceiverPolicyReg.hpp"
+#include "ReceiverPolicyUring.hpp"
 
 namespace malt {
 
 std::unique_ptr<IMaltRunner> makeRunner(
-        Config const& cfg, OutputHandler& oh, bool& stopped) {
+        Config const& cfg, OutputHandler& oh, StopFlag& stopped) {
     if (cfg.sender())
         return std::make_unique<MaltSender>(cfg, oh, stopped);
-    
+
+    if (! cfg.readFile().empty())
+        return std::make_unique<MaltReplay>(cfg, oh, stopped);
+
+    if (cfg.wildcard() && cfg.packetRing())
+        return std::make_unique<MaltReceiver<ReceiverPolicyPacketRing>>(
+                cfg, oh, stopped);
+
     if (cfg.wildcard())
         return std::make_unique<MaltReceiver<ReceiverPolicyRaw>>(cfg, oh, stopped);
-    
+
+    if (cfg.ioUring()) {
+        if (ReceiverPolicyUring::supported())
+            return std::make_unique<MaltReceiver<ReceiverPolicyUring>>(
+                    cfg, oh, stopped);
+
+        warning("io_uring multishot receive not supported by host, "
+                "falling back to recvmmsg()");
+    }
+
     return std::make_unique<MaltReceiver<ReceiverPolicyReg>>(cfg, oh, stopped);
 }
 
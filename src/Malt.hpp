@@ -1,11 +1,16 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include "Config.hpp"
 #include "OutputHandler.hpp"
 
 namespace malt {
 
+// Set by the signal handler or by a failed receiver worker to stop
+// all the malt threads
+using StopFlag = std::atomic<bool>;
+
 struct IMaltRunner {
     virtual bool run() = 0;
     virtual ~IMaltRunner() = default;
@@ -16,7 +21,8 @@ struct IMaltRunner {
  *
  * @return a unique ptr of the runner
  */
-std::unique_ptr<IMaltRunner> makeRunner(Config const&, OutputHandler&, bool&);
+std::unique_ptr<IMaltRunner> makeRunner(
+        Config const&, OutputHandler&, StopFlag&);
 
 
 } // namespace malt
\ No newline at end of file
@@ -1,9 +1,17 @@
 #pragma once
 
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
 #include <unistd.h>
+#include <cstdint>
 
+#include "vdunlib/unix/SysError.hpp"
+
+#include "AppUtils.hpp"
 #include "Config.hpp"
 #include "OutputHandler.hpp"
+#include "Malt.hpp"
 
 namespace malt {
 
@@ -12,9 +20,9 @@ protected:
     Config const& cfg_;
     OutputHandler& oh_;
     int s_;
-    bool& stopped_;
+    StopFlag& stopped_;
 
-    MaltBase(Config const& cfg, OutputHandler& oh, bool& stopped)
+    MaltBase(Config const& cfg, OutputHandler& oh, StopFlag& stopped)
     : cfg_{cfg}, oh_{oh}, s_{-1}, stopped_{stopped} {}
 
     ~MaltBase() {
@@ -25,6 +33,49 @@ protected:
             } while (rc == -1 && errno == EINTR);
         }
     }
+
+    /**
+     * Pins the calling thread to the CPU of the worker if any CPUs
+     * are configured
+     *
+     * @param role the kind of the worker, only used in the warning
+     */
+    void pinToCpu(unsigned worker, char const* role) const {
+        auto const& cpus = cfg_.cpus();
+        if (cpus.empty())
+            return;
+
+        unsigned cpu = cpus[worker % cpus.size()];
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu, &cpuSet);
+
+        int rc = pthread_setaffinity_np(
+                pthread_self(), sizeof(cpuSet), &cpuSet);
+        if (rc != 0)
+            warning("failed to pin ", role, " thread ", worker,
+                    " to CPU ", cpu, ": ", sysError(rc));
+    }
+
+    static uint64_t monotonicNanos() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+    }
+
+    /**
+     * Sleeps until the CLOCK_MONOTONIC time unless it is stopped, the
+     * absolute time keeps the cost of the caller's loop from adding up
+     */
+    void sleepUntil(uint64_t wakeNs) const {
+        timespec ts{};
+        ts.tv_sec = static_cast<time_t>(wakeNs / 1'000'000'000);
+        ts.tv_nsec = static_cast<long>(wakeNs % 1'000'000'000);
+        while (! stopped_
+               && clock_nanosleep(
+                       CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+            ;
+    }
 };
 
 } // namespace malt
\ No newline at end of file
@@ -1,10 +1,13 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 namespace malt {
 
 constexpr uint64_t MaltMagic{5505949305068913751};
+// The max UDP payload of an IPv4 datagram
+constexpr unsigned MaxBeaconSize{65507};
 
 struct MaltBeaconHdr final {
     uint64_t magic;
@@ -13,4 +16,63 @@ struct MaltBeaconHdr final {
     uint8_t dataLen;
 } __attribute__((__aligned__(1), __packed__));
 
+// The beacon sent by malt, only the hostname bytes given by dataLen
+// are sent, optionally followed by the padding
+struct MaltBeaconPacket final {
+    MaltBeaconHdr hdr;
+    char hostname[64];
+} __attribute__((__aligned__(1), __packed__));
+
+/**
+ * @return the beacon header if the payload holds the whole beacon
+ * without the padding, nullptr otherwise
+ */
+inline MaltBeaconHdr const* parseBeacon(
+        uint8_t const* payload, std::size_t payloadSize,
+        std::size_t capturedSize) {
+    if (capturedSize <= sizeof(MaltBeaconHdr))
+        return nullptr;
+
+    auto hdr = reinterpret_cast<MaltBeaconHdr const*>(payload);
+    if (hdr->magic != MaltMagic)
+        return nullptr;
+
+    std::size_t beaconSize = sizeof(MaltBeaconHdr) + hdr->dataLen;
+    if (payloadSize < beaconSize || capturedSize < beaconSize)
+        return nullptr;
+
+    return hdr;
+}
+
+/**
+ * @return the padding byte at the offset of the beacon, the bytes are
+ * derived from the sequence number, thus the receivers can check them
+ */
+inline uint8_t beaconPadding(uint64_t seq, std::size_t offset) {
+    auto base = static_cast<uint8_t>((seq * 0x9e3779b97f4a7c15ul) >> 56u);
+    return static_cast<uint8_t>(base + offset);
+}
+
+/**
+ * Pads the beacon from the offset up to the size
+ */
+inline void padBeacon(
+        uint8_t* beacon, std::size_t from, std::size_t size, uint64_t seq) {
+    for (std::size_t i{from}; i < size; ++i)
+        beacon[i] = beaconPadding(seq, i);
+}
+
+/**
+ * @return true if the bytes of the beacon from the offset up to the size
+ * are the padding of the sequence number
+ */
+inline bool checkBeaconPadding(
+        uint8_t const* beacon, std::size_t from, std::size_t size,
+        uint64_t seq) {
+    for (std::size_t i{from}; i < size; ++i)
+        if (beacon[i] != beaconPadding(seq, i))
+            return false;
+    return true;
+}
+
 } // namespace malt
\ No newline at end of file
@@ -1,215 +1,178 @@
 #pragma once
 
-#include <fcntl.h>
-#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
 
-#include "vdunlib/time/Time.hpp"
 #include "vdunlib/unix/SysError.hpp"
 
-#include "PacketInfo.hpp"
 #include "AppUtils.hpp"
+#include "AsyncOutput.hpp"
 #include "Config.hpp"
+#include "GroupTimeouts.hpp"
 #include "OutputHandler.hpp"
 #include "Malt.hpp"
-#include "MaltBase.hpp"
+#include "ReceiverWorker.hpp"
 #include "RxStats.hpp"
-#include "TimeoutCounter.hpp"
 
 namespace malt {
 
+/**
+ * Joins the groups and runs Config::threads() receiver workers, the
+ * first one in the calling thread and each of the others in its own
+ * thread. The stats of the workers are merged once all of them stop.
+ * The packets are shown by a separate output thread, which is stopped
+ * before the stats are shown.
+ */
 template <typename ReceiverPolicy>
-class MaltReceiver final: public IMaltRunner, protected MaltBase {
+class MaltReceiver final: public IMaltRunner {
+    using Worker = ReceiverWorker<ReceiverPolicy>;
+
 public:
 
     MaltReceiver(
-            Config const& cfg, OutputHandler& oh, bool& stopped)
-    : MaltBase{cfg, oh, stopped}, epfd_{-1} {
-        pinfo_.group = cfg_.group();
+            Config const& cfg, OutputHandler& oh, StopFlag& stopped)
+    : cfg_{cfg}, oh_{oh}, stopped_{stopped}, timeouts_{cfg}, count_{0}
+    , output_{cfg, oh} {
+        for (unsigned w{0}; w < cfg.threads(); ++w)
+            workers_.push_back(std::make_unique<Worker>(
+                    cfg, oh, stopped, w, timeouts_, count_, output_));
     }
 
-    bool init() {
-        s_ = ReceiverPolicy::openSocket();
-        if (s_ == -1)
-            return false;
+    ~MaltReceiver() {
+        for (int js: joinSockets_) {
+            int rc;
+            do {
+                rc = close(js);
+            } while (rc == -1 && errno == EINTR);
+        }
+    }
 
-        if (! configureSocket())
-            return false;
+    bool init() {
+        // The sockets are bound in the order of the workers
+        for (auto& worker: workers_)
+            if (! worker->init())
+                return false;
 
-        return activatePoller();
+        return joinGroups(workers_.front()->membershipSocket());
     }
 
     bool run() final {
         if (! init())
             return false;
-        
-        bool r = tryRun();
 
+        if (! cfg_.seqTracking())
+            warning("the lost beacons are not tracked, the fanout mode "
+                    "spreads the packets of a flow over the threads");
+
+        output_.start();
+        bool r = runWorkers();
+        output_.stop();
+
+        RxStats rxStats{cfg_.groups().size(), cfg_.flowCapacity()};
+        for (auto const& worker: workers_)
+            rxStats.merge(worker->rxStats());
+        rxStats.droppedLines(output_.droppedLines());
         oh_.showRxStats(rxStats);
         return r;
     }
 
 private:
-    int epfd_;
-    PacketInfo pinfo_;
-    RxStats rxStats;
-
-    bool configureSocket() {
-        // Make socket non-blocking
-        int flags = fcntl(s_, F_GETFL);
-        if (flags == -1)
-            return sysCallError("fcntl() failed to get socket flags");
-
-        flags |= O_NONBLOCK;
-        int rv = fcntl(s_, F_SETFL, flags);
-        if (rv == -1)
-            return sysCallError("fcntl() failed to make socket non-blocking");
-
-        // allow multiple sockets use the same UDP ports
-        uint allowReuse = 1;
-        if (setsockopt(s_, SOL_SOCKET, SO_REUSEADDR,
-                       &allowReuse, sizeof(allowReuse)) == -1)
-            return sysCallError("cannot enable UDP port reuse");
-
-        int bufSize{BufferSize};
-        if (setsockopt(s_, SOL_SOCKET,
-                SO_RCVBUF, &bufSize, sizeof(bufSize)) == -1) {
-            warning("failed to set receive buffer size to ",
-                    bufSize, " bytes: ", sysError(errno));
+    Config const& cfg_;
+    OutputHandler& oh_;
+    StopFlag& stopped_;
+    GroupTimeouts timeouts_;
+    // The number of the packets received by all the workers, it is
+    // only counted if the count is limited
+    std::atomic<uint64_t> count_;
+    AsyncOutput output_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    // The auxiliary sockets joining the groups which didn't fit into
+    // the membership socket of the policy
+    std::vector<int> joinSockets_;
+
+    bool runWorkers() {
+        if (workers_.size() == 1)
+            return workers_.front()->run();
+
+        std::unique_ptr<bool[]> results{new bool[workers_.size()]};
+        std::vector<std::thread> threads;
+        threads.reserve(workers_.size() - 1);
+        for (std::size_t w{1}; w < workers_.size(); ++w) {
+            threads.emplace_back([this, w, &results] {
+                results[w] = workers_[w]->run();
+            });
         }
 
-        if (! ReceiverPolicy::configureSocket(s_))
-            return false;
+        results[0] = workers_.front()->run();
 
-        // Bind the socket to any interface. The join will be sent
-        // from the interface specified on the command line
-        sockaddr_in src{};
-        memset(&src, 0, sizeof(src));
-        src.sin_family = AF_INET;
-        src.sin_port = htons(cfg_.dport());
-        src.sin_addr.s_addr = INADDR_ANY;
-
-        if (bind(s_, reinterpret_cast<sockaddr*>(&src), sizeof(src)) == -1)
-            return error("cannot bind to UDP port ",
-                         cfg_.dport(), ": ", sysError(errno));
-
-        return true;
-    }
-
-    bool activatePoller() {
-        epfd_ = epoll_create1(0);
-        if (epfd_ == -1)
-            return sysCallError("unable to create epoll instance");
-
-        epoll_event ev{};
-        ev.data.fd = s_;
-        ev.events = EPOLLIN | EPOLLPRI;
-
-        if (epoll_ctl(epfd_, EPOLL_CTL_ADD, s_, &ev) == -1)
-            return sysCallError("unable to add socket to epoll instance");
+        bool r{true};
+        for (std::size_t w{0}; w < workers_.size(); ++w) {
+            if (w > 0)
+                threads[w - 1].join();
+            r = r && results[w];
+        }
 
-        return true;
+        return r;
     }
 
-    bool join() {
+    bool addMembership(int s, net::IPv4Address group) {
         if (cfg_.source() != net::IPv4Address{}) {
             ip_mreq_source mreq_source{};
             mreq_source.imr_interface.s_addr = cfg_.intfAddr().to_nl();
-            mreq_source.imr_multiaddr.s_addr = cfg_.group().to_nl();
+            mreq_source.imr_multiaddr.s_addr = group.to_nl();
             mreq_source.imr_sourceaddr.s_addr = cfg_.source().to_nl();
 
-            if (setsockopt(s_, IPPROTO_IP, IP_ADD_SOURCE_MEMBERSHIP,
-                           &mreq_source, sizeof(mreq_source)) == -1)
-                return error("failed to join (",
-                             cfg_.source(),',', cfg_.group(), ") on ",
-                             cfg_.intf(), ": ", sysError(errno));
-        } else {
-            ip_mreq mreq{};
-            mreq.imr_interface.s_addr = cfg_.intfAddr().to_nl();
-            mreq.imr_multiaddr.s_addr = cfg_.group().to_nl();
-
-            if (setsockopt(s_, IPPROTO_IP,
-                           IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == -1)
-                return error("failed to join (*,", cfg_.group(), ") on ",
-                             cfg_.intf(), ": ", sysError(errno));
+            return setsockopt(s, IPPROTO_IP, IP_ADD_SOURCE_MEMBERSHIP,
+                              &mreq_source, sizeof(mreq_source)) == 0;
         }
 
-        return true;
-    }
-
-    bool tryRun() {
-        if (! join())
-            return false;
-
-        RxStats::Timer rxStatsTimer{rxStats};
-        epoll_event rcvEv{};
-        uint64_t count{0};
-        TimeoutCounter timeout{cfg_};
-
-        while (! stopped_) {
-            int rc = epoll_wait(epfd_, &rcvEv, 1, 100);
-            timeout.timestamp();
-
-            if (rc == -1) {
-                if (errno == EINTR)
-                    continue;
+        ip_mreq mreq{};
+        mreq.imr_interface.s_addr = cfg_.intfAddr().to_nl();
+        mreq.imr_multiaddr.s_addr = group.to_nl();
 
-                return sysCallError(
-                        "failure while waiting on epoll instance");
-            }
-
-            if (rc == 0) {
-                if (timeout) {
-                    oh_.showTimeout(timeout.getTimestamp());
-                    timeout.reset();
-                }
+        return setsockopt(s, IPPROTO_IP,
+                          IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == 0;
+    }
 
-                continue;
+    /**
+     * Joins all the groups. The kernel limits the number of memberships
+     * per socket (net.ipv4.igmp_max_memberships), thus once a socket is
+     * full the following groups are joined from a new auxiliary socket.
+     * The auxiliary sockets are never bound and receive nothing, while
+     * the sockets of the workers receive the traffic of all the groups
+     * joined on the host.
+     */
+    bool joinGroups(int s) {
+        for (auto group: cfg_.groups()) {
+            bool joined = addMembership(s, group);
+            if (! joined && errno == ENOBUFS) {
+                s = socket(AF_INET, SOCK_DGRAM, 0);
+                if (s == -1)
+                    return sysCallError("unable to create socket");
+
+                joinSockets_.push_back(s);
+                joined = addMembership(s, group);
             }
 
-            if (rcvEv.events & EPOLLHUP)
-                return error("received epoll hangup");
-
-            if (rcvEv.events & EPOLLERR) {
-                int soError{0};
-                socklen_t soErrorLen{sizeof(soError)};
-
-                rc = getsockopt(s_,
-                        SOL_SOCKET, SO_ERROR, &soError, &soErrorLen);
+            if (! joined) {
+                if (cfg_.source() != net::IPv4Address{})
+                    return error("failed to join (",
+                                 cfg_.source(),',', group, ") on ",
+                                 cfg_.intf(), ": ", sysError(errno));
 
-                if (rc == -1)
-                    return sysCallError(
-                            "epoll_wait indicated socket error, "
-                            "but getsockopt() unabled to get the error code");
-
-                return error("socket error: ", sysError(soError));
-            }
-
-            if ((rcvEv.events & EPOLLIN) || (rcvEv.events & EPOLLPRI)) {
-                switch (ReceiverPolicy::receivePacket(
-                        s_, pinfo_, cfg_, timeout.getTimestamp())) {
-                case ReceivedPacket::Accepted:
-                    pinfo_.timestamp = timeout.getTimestamp();
-                    timeout.reset();
-                    oh_.showRcvdPacket(pinfo_);
-                    rxStats.update(
-                            pinfo_.source, pinfo_.sport,
-                            pinfo_.dport, pinfo_.payloadSize);
-                    if (cfg_.count() > 0 && ++count > cfg_.count())
-                        return true;
-                    break;
-
-                case ReceivedPacket::Filtered:
-                    continue;
-
-                case ReceivedPacket::Failed:
-                    return false;
-                }
+                return error("failed to join (*,", group, ") on ",
+                             cfg_.intf(), ": ", sysError(errno));
             }
         }
 
-        // we were stopped
         return true;
     }
 };
 
-} // namespace malt
\ No newline at end of file
+} // namespace malt
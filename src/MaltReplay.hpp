@@ -0,0 +1,226 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <linux/ip.h>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+
+#include "vdunlib/time/Time.hpp"
+
+#include "PacketInfo.hpp"
+#include "AppUtils.hpp"
+#include "CaptureReader.hpp"
+#include "Config.hpp"
+#include "IPv4UdpParser.hpp"
+#include "LineBudget.hpp"
+#include "OutputHandler.hpp"
+#include "Malt.hpp"
+#include "PcapngWriter.hpp"
+#include "RxStats.hpp"
+
+namespace malt {
+
+/**
+ * Replays the packets of a capture file instead of receiving them from
+ * a socket. The packets pass the same filter as the packets received
+ * by the raw socket and the accepted ones are shown, accounted and
+ * written just like the received ones. The file is read as fast as the
+ * disk allows in batches of Config::batch() packets. The packet lines
+ * are limited to Config::lineRate() per second of the capture, thus
+ * a long capture isn't replayed at the speed of the terminal. The stats
+ * cover the time span of the capture, the timeouts are not reported.
+ */
+class MaltReplay final: public IMaltRunner {
+    static constexpr uint16_t IPv4FragOffsetMask{0x1fff};
+
+public:
+    MaltReplay(Config const& cfg, OutputHandler& oh, StopFlag& stopped)
+    : cfg_{cfg}
+    , oh_{oh}
+    , stopped_{stopped}
+    , batch_{cfg.batch()}
+    , rxStats_{cfg.groups().size(), cfg.flowCapacity()}
+    , filterStats_{}
+    , firstTs_{0}
+    , lastTs_{0}
+    , count_{0}
+    , lineBudget_{cfg.lineRate(), 0}
+    , displayTs_{0} {
+        if (! cfg.writeFile().empty())
+            writer_ = std::make_unique<PcapngWriter>(cfg, 0);
+    }
+
+    bool run() final {
+        if (! reader_.open(cfg_.readFile()))
+            return false;
+
+        if (writer_ && ! writer_->open())
+            return false;
+
+        bool r = replay();
+        // The last display interval ends with the capture
+        if (cfg_.lineRate() > 0)
+            lineBudget_.end(displayTs_, cfg_.groups(), rxStats_,
+                    [this] (FlowSummary const& summary) {
+                oh_.showFlowSummary(summary);
+            });
+
+        // A capture of a single packet has no time span
+        rxStats_.durationNanos(
+                lastTs_ > firstTs_ ? lastTs_ - firstTs_ : 1'000'000'000);
+        rxStats_.filterStats(filterStats_);
+        oh_.showRxStats(rxStats_);
+        return r;
+    }
+
+private:
+    Config const& cfg_;
+    OutputHandler& oh_;
+    StopFlag& stopped_;
+    CaptureReader reader_;
+    PacketBatch batch_;
+    RxStats rxStats_;
+    FilterStats filterStats_;
+    uint64_t firstTs_;
+    uint64_t lastTs_;
+    uint64_t count_;
+    LineBudget lineBudget_;
+    // The latest time of the packets shown
+    uint64_t displayTs_;
+    // Only set if the packets are written into a capture file
+    std::unique_ptr<PcapngWriter> writer_;
+
+    bool replay() {
+        while (! stopped_) {
+            auto rr = readBatch();
+            if (rr == CaptureReader::Result::Failed)
+                return false;
+
+            if (processBatch() || rr == CaptureReader::Result::End)
+                break;
+        }
+
+        return true;
+    }
+
+    /**
+     * Reads the packets until the batch is full of the accepted ones
+     * or the end of the file is reached
+     */
+    CaptureReader::Result readBatch() {
+        unsigned n{0};
+        auto rr = CaptureReader::Result::Packet;
+        while (n < batch_.capacity()) {
+            CapturedPacket pkt;
+            rr = reader_.next(pkt);
+            if (rr != CaptureReader::Result::Packet)
+                break;
+
+            if (pkt.timestamp != 0) {
+                if (firstTs_ == 0)
+                    firstTs_ = pkt.timestamp;
+                lastTs_ = std::max(lastTs_, pkt.timestamp);
+            }
+
+            if (acceptPacket(pkt, batch_[n]))
+                ++n;
+        }
+
+        batch_.resize(n);
+        return rr;
+    }
+
+    /**
+     * Filters the packet as ReceiverPolicyRaw does, except that the
+     * packets of the other UDP ports are also filtered unless the UDP
+     * port is a wildcard, as there is no socket bound to the port.
+     * The fragments following the first one carry no UDP header and
+     * the capture doesn't reassemble them, thus they are filtered.
+     */
+    bool acceptPacket(CapturedPacket const& pkt, PacketInfo& pinfo) {
+        // The timestamp of the warnings
+        uint64_t pktTs = pkt.timestamp != 0
+                ? pkt.timestamp : TimeUtils::gethostnanos();
+
+        bool accepted{false};
+        if (pkt.capturedSize >= sizeof(iphdr)
+            && (ntohs(reinterpret_cast<iphdr const*>(pkt.data)->frag_off)
+                & IPv4FragOffsetMask) == 0) {
+            accepted = parseIPv4Udp(
+                    pkt.data, pkt.capturedSize, pkt.origSize,
+                    cfg_, pinfo, pktTs) == ReceivedPacket::Accepted
+                && (cfg_.wildcard() || pinfo.dport == cfg_.dport());
+        }
+
+        if (! accepted) {
+            filterStats_.add(pkt.origSize);
+            return false;
+        }
+
+        // The same prefix of the payload as the policies capture
+        pinfo.capturedSize = std::min(
+                pinfo.capturedSize, payloadCaptureSize(cfg_.showPayload()));
+        pinfo.timestamp = pkt.timestamp;
+        return true;
+    }
+
+    /**
+     * Shows, accounts and writes the packets of the batch. If the packet
+     * count limit is reached in the middle of the batch the remaining
+     * packets are ignored.
+     *
+     * @return true if the packet count limit is reached
+     */
+    bool processBatch() {
+        unsigned n = batch_.size();
+        bool countReached{false};
+        if (cfg_.count() > 0) {
+            if (cfg_.count() - count_ <= n) {
+                n = static_cast<unsigned>(cfg_.count() - count_);
+                countReached = true;
+                // The capture ends with the last counted packet
+                if (n > 0 && batch_[n - 1].timestamp != 0)
+                    lastTs_ = batch_[n - 1].timestamp;
+            }
+            count_ += n;
+        }
+
+        // The host time is only needed if the capture has no timestamps
+        uint64_t hostTs{0};
+        for (unsigned i{0}; i < n; ++i) {
+            PacketInfo& pinfo = batch_[i];
+            if (pinfo.timestamp == 0) {
+                if (hostTs == 0)
+                    hostTs = TimeUtils::gethostnanos();
+                pinfo.timestamp = hostTs;
+            }
+            if (cfg_.lineRate() == 0 || takeLine(pinfo.timestamp))
+                oh_.showRcvdPacket(pinfo);
+            if (writer_ && ! writer_->write(pinfo))
+                writer_.reset();
+            SeqGap gap = rxStats_.update(pinfo, false, cfg_.seqTracking());
+            if (gap.count > 0)
+                oh_.showSeqGap(gap);
+        }
+
+        return countReached;
+    }
+
+    /**
+     * Ends the display interval once the time of the capture has passed
+     * it
+     *
+     * @return true if the line of the packet may be shown
+     */
+    bool takeLine(uint64_t pktTs) {
+        displayTs_ = std::max(displayTs_, pktTs);
+        lineBudget_.check(pktTs, cfg_.groups(), rxStats_,
+                [this] (FlowSummary const& summary) {
+            oh_.showFlowSummary(summary);
+        });
+        return lineBudget_.takeLine();
+    }
+};
+
+} // namespace malt
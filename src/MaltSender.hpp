@@ -4,8 +4,9 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include <cstring>
+#include <memory>
 #include <thread>
-#include <chrono>
+#include <vector>
 
 #include "vdunlib/time/Time.hpp"
 #include "vdunlib/formatters/IPv4Formatters.hpp"
@@ -16,21 +17,24 @@
 #include "OutputHandler.hpp"
 #include "Malt.hpp"
 #include "MaltBase.hpp"
-
-using namespace std::chrono_literals;
+#include "RxStats.hpp"
+#include "SenderWorker.hpp"
+#include "SizeMix.hpp"
+#include "TxStats.hpp"
 
 namespace malt {
 
+/**
+ * Sends the beacons. A single flow without a rate sends one packet per
+ * Config::intervalMs() and shows it, otherwise the flows are paced by
+ * Config::threads() sender workers, the first one running in the
+ * calling thread and each of the others in its own thread.
+ */
 class MaltSender final: public IMaltRunner, protected MaltBase {
-    struct MaltBeaconPacket {
-        MaltBeaconHdr hdr;
-        char hostname[64];
-    } __attribute__((__aligned__(1), __packed__));
-
 public:
     MaltSender(
-            Config const& cfg, OutputHandler& oh, bool& stopped)
-    : MaltBase{cfg, oh, stopped} {
+            Config const& cfg, OutputHandler& oh, StopFlag& stopped)
+    : MaltBase{cfg, oh, stopped}, txStats_{} {
         pkt_.hdr.magic = MaltMagic;
         pkt_.hdr.seq = 0;
     }
@@ -41,48 +45,49 @@ public:
 
         pkt_.hostname[sizeof(pkt_.hostname) - 1] = '\0';
         pkt_.hdr.dataLen = static_cast<uint8_t>(strlen(pkt_.hostname));
-        pktSize_ = sizeof(MaltBeaconHdr) + pkt_.hdr.dataLen;
+
+        if (paced()) {
+            for (unsigned w{0}; w < cfg_.threads(); ++w) {
+                workers_.push_back(std::make_unique<SenderWorker>(
+                        cfg_, oh_, stopped_, w, pkt_));
+                if (! workers_.back()->init())
+                    return false;
+            }
+            return true;
+        }
+
+        unsigned beaconSize = sizeof(MaltBeaconHdr) + pkt_.hdr.dataLen;
+        mix_ = std::make_unique<SizeMix>(cfg_.sizes(), beaconSize);
+        buf_.resize(mix_->maxSize());
+        memcpy(buf_.data(), &pkt_, beaconSize);
 
         s_ = socket(AF_INET, SOCK_DGRAM, 0);
 
         if (s_ == -1)
             sysCallError("unable to create socket");
 
-        auto ttl = static_cast<u_char>(cfg_.ttl());
-        if (setsockopt(s_, IPPROTO_IP,
-                       IP_MULTICAST_TTL, &ttl, sizeof(ttl)) == -1)
-            return error("unable to set TTL ", ttl, ": ", sysError(errno));
-
-        // this is required to allow this host to receive its own packets
-        u_char loopback{1};
-        if (setsockopt(s_, IPPROTO_IP,
-                       IP_MULTICAST_LOOP, &loopback, sizeof(loopback)) == -1)
-            return error("unable to set loopback mode on socket");
-
-        in_addr intfAddr { .s_addr = cfg_.intfAddr().to_nl() };
-        if (setsockopt(s_, IPPROTO_IP,
-            IP_MULTICAST_IF, &intfAddr, sizeof(intfAddr)) == -1)
-            return error("unable to make ", cfg_.intf(),
-                         " (addr ", cfg_.intfAddr(),
-                         ") output multicast interface",
-                         sysError(errno));
-
-        return true;
+        return configureSenderSocket(cfg_, s_);
     }
 
     bool run() final {
         if (! init())
             return false;
-        
-        bool r = tryRun();
 
-        oh_.showTxStats(pkt_.hdr.seq);
+        bool r = paced() ? runWorkers() : tryRun();
+
+        oh_.showTxStats(txStats_);
         return r;
     }
 
 private:
     MaltBeaconPacket pkt_;
-    unsigned pktSize_;
+    // The beacon padded to the sizes of the mix if the flow isn't paced
+    std::unique_ptr<SizeMix> mix_;
+    std::vector<uint8_t> buf_;
+    TxStats txStats_;
+    std::vector<std::unique_ptr<SenderWorker>> workers_;
+
+    bool paced() const { return cfg_.flows().front().rate > 0; }
 
     bool tryRun() {
         sockaddr_in dst{};
@@ -90,28 +95,80 @@ private:
         dst.sin_port = htons(cfg_.dport());
         dst.sin_addr.s_addr = cfg_.group().to_nl();
 
+        auto hdr = reinterpret_cast<MaltBeaconHdr*>(buf_.data());
+        unsigned beaconSize = sizeof(MaltBeaconHdr) + hdr->dataLen;
+        // The packet k is due k intervals after the start, whatever
+        // the sending and the output cost
+        uint64_t intervalNs = cfg_.intervalMs() * 1'000'000ul;
+        uint64_t startNs = monotonicNanos();
+        uint64_t dueNs = startNs;
         while (! stopped_) {
-            pkt_.hdr.timeNs = TimeUtils::gethostnanos();
-            if (sendto(s_, &pkt_, pktSize_, 0,
+            hdr->timeNs = TimeUtils::gethostnanos();
+            unsigned size = mix_->size(hdr->seq);
+            padBeacon(buf_.data(), beaconSize, size, hdr->seq);
+            if (sendto(s_, buf_.data(), size, 0,
                     reinterpret_cast<sockaddr*>(&dst), sizeof(dst)) == -1) {
                 return error(
                         "failed to send packet to ",
                         cfg_.group(), ':', cfg_.dport(), ": ",
                         sysError(errno));
             }
-            
-            oh_.showSentPacket(pkt_.hdr);
-            ++pkt_.hdr.seq;
 
-            if (cfg_.count() != 0 && pkt_.hdr.seq >= cfg_.count())
+            oh_.showSentPacket(*hdr);
+            ++hdr->seq;
+            ++txStats_.pkts;
+            txStats_.bytes += FlowStats::withHeaders(size);
+
+            // The run covers the interval of the last packet
+            if (cfg_.count() != 0 && hdr->seq >= cfg_.count()) {
+                txStats_.durationNanos = dueNs + intervalNs - startNs;
                 return true;
+            }
 
-            std::this_thread::sleep_for(1s);
+            // The deadlines passed before the next one are skipped
+            // instead of bursting to catch up
+            dueNs += intervalNs;
+            uint64_t nowNs = monotonicNanos();
+            if (nowNs >= dueNs + intervalNs) {
+                uint64_t missed = (nowNs - dueNs) / intervalNs;
+                txStats_.missedDeadlines += missed;
+                dueNs += missed * intervalNs;
+            }
+            sleepUntil(dueNs);
         }
 
-        // we're stopped
+        txStats_.durationNanos = monotonicNanos() - startNs;
         return true;
     }
+
+    bool runWorkers() {
+        bool r{true};
+        if (workers_.size() == 1) {
+            r = workers_.front()->run();
+        } else {
+            std::unique_ptr<bool[]> results{new bool[workers_.size()]};
+            std::vector<std::thread> threads;
+            threads.reserve(workers_.size() - 1);
+            for (std::size_t w{1}; w < workers_.size(); ++w) {
+                threads.emplace_back([this, w, &results] {
+                    results[w] = workers_[w]->run();
+                });
+            }
+
+            results[0] = workers_.front()->run();
+
+            for (std::size_t w{0}; w < workers_.size(); ++w) {
+                if (w > 0)
+                    threads[w - 1].join();
+                r = r && results[w];
+            }
+        }
+
+        for (auto const& worker: workers_)
+            txStats_.merge(worker->txStats());
+
+        return r;
+    }
 };
 
-} // namespace malt
\ No newline at end of file
+} // namespace malt
@@ -24,18 +24,19 @@ std::string fmtTtl(int16_t ttl) {
 }
 
 bool showMaltPacket(PacketInfo const& pinfo, bool colors) {
-    if (pinfo.payloadSize <= sizeof(MaltBeaconHdr)) return false;
-
-    auto hdr = reinterpret_cast<MaltBeaconHdr const*>(pinfo.payload);
-    if (hdr->magic != MaltMagic) return false;
-
-    if (pinfo.payloadSize != sizeof(MaltBeaconHdr) + hdr->dataLen)
-        return false;
+    // The whole beacon must have been captured to decode the source name,
+    // the beacon may be padded, but only the captured padding is checked
+    auto hdr = parseBeacon(
+            pinfo.payload, pinfo.payloadSize, pinfo.capturedSize);
+    if (hdr == nullptr) return false;
 
+    std::size_t beaconSize = sizeof(MaltBeaconHdr) + hdr->dataLen;
     char const* s = reinterpret_cast<char const*>(
             pinfo.payload + sizeof(MaltBeaconHdr));
     std::string sourceName{
         s, static_cast<std::string::size_type>(hdr->dataLen)};
+    bool badPadding = ! checkBeaconPadding(pinfo.payload, beaconSize,
+            std::min(pinfo.payloadSize, pinfo.capturedSize), hdr->seq);
 
     fmt::memory_buffer buf{};
     if (colors) fmt::format_to(buf, TERM_COLOR_RED_BRIGHT);
@@ -45,6 +46,7 @@ bool showMaltPacket(PacketInfo const& pinfo, bool colors) {
             pinfo.source, pinfo.sport, pinfo.group, pinfo.dport,
             fmtTtl(pinfo.ttl), pinfo.payloadSize,
             hdr->seq, sourceName, strTs(hdr->timeNs));
+    if (badPadding) fmt::format_to(buf, ", corrupted padding");
     if (colors) fmt::format_to(buf, TERM_COLOR_RESET);
     fmt::print("{}\n", fmt::to_string(buf));
     return true;
@@ -68,9 +70,9 @@ void showPayload(PacketInfo const& pinfo, bool colors) {
     fmt::memory_buffer buf{};
     if (colors) fmt::format_to(buf, TERM_COLOR_YELLOW);
 
-    for (unsigned start = 0; start < pinfo.payloadSize; start += 16) {
+    for (unsigned start = 0; start < pinfo.capturedSize; start += 16) {
         unsigned end =
-                pinfo.payloadSize - start < 16 ? pinfo.payloadSize : start + 16;
+                pinfo.capturedSize - start < 16 ? pinfo.capturedSize : start + 16;
 
         fmt::format_to(buf, "  ");
 
@@ -85,8 +87,8 @@ void showPayload(PacketInfo const& pinfo, bool colors) {
         // If the last row is shorter than 16 characters fill in
         // the missing hex values with blanks. Nothing needs to
         // be done with the payload_size is multiple of 16
-        if (end == pinfo.payloadSize && pinfo.payloadSize % 16 != 0) {
-            for (auto i = pinfo.payloadSize % 16; i < 16; i++) {
+        if (end == pinfo.capturedSize && pinfo.capturedSize % 16 != 0) {
+            for (auto i = pinfo.capturedSize % 16; i < 16; i++) {
                 if (i == 8) fmt::format_to(buf, " ");
                 fmt::format_to(buf, "   ");
             }
@@ -101,7 +103,7 @@ void showPayload(PacketInfo const& pinfo, bool colors) {
                                "{}", static_cast<char>(pinfo.payload[i]));
             else fmt::format_to(buf, ".");
         }
-        if (end != pinfo.payloadSize)
+        if (end != pinfo.capturedSize)
             fmt::format_to(buf, "\n");
     }
 
@@ -109,6 +111,27 @@ void showPayload(PacketInfo const& pinfo, bool colors) {
     fmt::print("{}\n", fmt::to_string(buf));
 }
 
+std::string fmtRate(uint64_t bytes, uint64_t duration) {
+    double rate =
+            static_cast<double>(bytes << 3u) * 1'000'000'000 / duration;
+    if (rate < 1000)
+        return fmt::format("{:.2f}bps", rate);
+    if (rate < 1'000'000)
+        return fmt::format("{:.2f}Kbps", rate/1'000);
+    if (rate < 1'000'000'000)
+        return fmt::format("{:.2f}Mbps", rate/1'000'000);
+    return fmt::format("{:.2f}Gbps", rate/1'000'000'000);
+}
+
+std::string fmtPktRate(uint64_t pkts, uint64_t duration) {
+    double rate = static_cast<double>(pkts) * 1'000'000'000 / duration;
+    if (rate < 1000)
+        return fmt::format("{:.2f}pps", rate);
+    if (rate < 1'000'000)
+        return fmt::format("{:.2f}Kpps", rate/1'000);
+    return fmt::format("{:.2f}Mpps", rate/1'000'000);
+}
+
 struct FlowStatsView {
     std::string source;
     std::string dport;
@@ -135,16 +158,7 @@ FlowStatsView flowStatsView(
     fsv.bytes = fmt::format("{}", flowStats.bytes());
     fsv.aps = fmt::format("{}", flowStats.avgPktSize());
 
-    double rate =
-            static_cast<double>(flowStats.bytes() << 3u)
-            * 1'000'000'000 / duration;
-    if (rate < 1000)
-        fsv.rate = fmt::format("{:.2f}bps", rate);
-    else if (rate < 1'000'000)
-        fsv.rate = fmt::format("{:.2f}Kbps", rate/1'000);
-    else if (rate < 1'000'000'000)
-        fsv.rate = fmt::format("{:.2f}Mbps", rate/1'000'000);
-    else fsv.rate = fmt::format("{:.2f}Gbps", rate/1'000'000'000);
+    fsv.rate = fmtRate(flowStats.bytes(), duration);
 
     return fsv;
 }
@@ -170,14 +184,153 @@ std::string rcvdDur(uint64_t duration) {
     return fmt::format("{}.{}", secs, nt.buf);
 }
 
+using TableRow = std::vector<std::string>;
+
+/**
+ * Shows the table under the title, the first row holds the captions,
+ * the source and the UDP port are aligned to the left
+ */
+void fmtTable(char const* title,
+        std::vector<TableRow> const& rows, fmt::memory_buffer& buf) {
+    std::size_t columns = rows.front().size();
+    std::vector<std::size_t> lens(columns, 0);
+    for (auto const& row: rows)
+        for (std::size_t c{0}; c < columns; ++c)
+            lens[c] = std::max(lens[c], row[c].length());
+
+    auto fmtRow = [&buf, &lens, columns] (TableRow const& row) {
+        fmt::format_to(buf, "{:<{}} {:<{}}", row[0], lens[0], row[1], lens[1]);
+        for (std::size_t c{2}; c < columns; ++c)
+            fmt::format_to(buf, " {:>{}}", row[c], lens[c]);
+        fmt::format_to(buf, "\n");
+    };
+
+    fmt::format_to(buf, "{}\n", title);
+    fmtRow(rows.front());
+    TableRow seps(columns);
+    for (std::size_t c{0}; c < columns; ++c)
+        seps[c] = sep(lens[c]);
+    fmtRow(seps);
+    for (std::size_t r{1}; r < rows.size(); ++r)
+        fmtRow(rows[r]);
+}
+
+std::string fmtLatency(int64_t ns) {
+    return fmt::format("{:.1f}", static_cast<double>(ns) / 1'000);
+}
+
+/**
+ * Shows the one-way latencies in microseconds of the flows which
+ * received any beacon, the latencies are only meaningful if the clocks
+ * of the senders are synchronized with the clock of the receiver
+ */
+void fmtLatencyStats(GroupRxStats const& rxStats, fmt::memory_buffer& buf) {
+    std::vector<TableRow> rows;
+    rows.push_back(TableRow{CapSource, CapDPort, "Samples",
+            "Min", "P50", "P90", "P99", "P99.9", "Max"});
+    rxStats.sortedForEach(
+            [&rows] (auto source, auto sport, auto dport, auto const& fs) {
+        LatencyHistogram const& lh = fs.latency();
+        if (lh.count() == 0) return;
+
+        rows.push_back(TableRow{
+                fmt::format("{}:{}", source, sport),
+                fmt::format("{}", dport), fmt::format("{}", lh.count()),
+                fmtLatency(lh.min()), fmtLatency(lh.percentile(50)),
+                fmtLatency(lh.percentile(90)), fmtLatency(lh.percentile(99)),
+                fmtLatency(lh.percentile(99.9)), fmtLatency(lh.max())});
+    });
+    if (rows.size() > 1)
+        fmtTable("One-way latency in usec", rows, buf);
+}
+
+std::string fmtLoss(uint64_t lost, uint64_t expected) {
+    return fmt::format("{:.3f}%",
+            static_cast<double>(lost) * 100 / static_cast<double>(expected));
+}
+
+/**
+ * Shows the beacons lost, reordered, duplicated and late of the flows
+ * which received any beacon
+ */
+void fmtSeqStats(GroupRxStats const& rxStats, fmt::memory_buffer& buf) {
+    std::vector<TableRow> rows;
+    rows.push_back(TableRow{CapSource, CapDPort, "Expected", "Lost", "Loss",
+            "Gaps", "Reordered", "Duplicates", "Late"});
+    rxStats.sortedForEach(
+            [&rows] (auto source, auto sport, auto dport, auto const& fs) {
+        SeqTracker const& st = fs.seq();
+        if (st.beacons() == 0) return;
+
+        rows.push_back(TableRow{
+                fmt::format("{}:{}", source, sport),
+                fmt::format("{}", dport), fmt::format("{}", st.expected()),
+                fmt::format("{}", st.lost()),
+                fmtLoss(st.lost(), st.expected()),
+                fmt::format("{}", st.gaps()),
+                fmt::format("{}", st.reordered()),
+                fmt::format("{}", st.duplicates()),
+                fmt::format("{}", st.late())});
+        if (st.restarts() > 0)
+            rows.back()[0] += fmt::format(" ({} restarts)", st.restarts());
+    });
+    if (rows.size() > 1)
+        fmtTable("Beacon sequence numbers", rows, buf);
+}
+
+std::string fmtGapBucket(unsigned b) {
+    if (b == 0) return "<1";
+    if (b == 1) return "1";
+    if (b == ArrivalStats::Buckets - 1)
+        return fmt::format("{}+", 1u << (b - 1));
+    return fmt::format("{}-{}", 1u << (b - 1), (1u << b) - 1);
+}
+
+/**
+ * Shows the interarrival jitter and the inter-packet gaps of the flows
+ * which received several packets, only the buckets holding any gap of
+ * the group get a column
+ */
+void fmtArrivalStats(GroupRxStats const& rxStats, fmt::memory_buffer& buf) {
+    bool used[ArrivalStats::Buckets]{};
+    rxStats.sortedForEach(
+            [&used] (auto, auto, auto, auto const& fs) {
+        for (unsigned b{0}; b < ArrivalStats::Buckets; ++b)
+            used[b] = used[b] || fs.arrival().bucket(b) > 0;
+    });
+
+    std::vector<TableRow> rows;
+    rows.push_back(TableRow{CapSource, CapDPort, "Jitter"});
+    for (unsigned b{0}; b < ArrivalStats::Buckets; ++b)
+        if (used[b]) rows.front().push_back(fmtGapBucket(b));
+
+    rxStats.sortedForEach(
+            [&rows, &used] (auto source, auto sport, auto dport,
+                            auto const& fs) {
+        if (fs.pkts() < 2) return;
+
+        ArrivalStats const& as = fs.arrival();
+        rows.push_back(TableRow{
+                fmt::format("{}:{}", source, sport),
+                fmt::format("{}", dport),
+                fmtLatency(static_cast<int64_t>(as.jitterNs()))});
+        for (unsigned b{0}; b < ArrivalStats::Buckets; ++b)
+            if (used[b]) rows.back().push_back(
+                    fmt::format("{}", as.bucket(b)));
+    });
+    if (rows.size() > 1)
+        fmtTable("Interarrival jitter and inter-packet gaps in usec",
+                rows, buf);
+}
+
 void fmtRxStats(
         net::IPv4Address group, uint dport, bool wildcard,
-        RxStats const& rxStats, fmt::memory_buffer& buf) {
+        GroupRxStats const& rxStats, uint64_t duration,
+        fmt::memory_buffer& buf) {
     if (rxStats.size() == 0) {
         fmt::format_to(buf,
                 "No traffic received for {} in {} sec\n",
-                fmtGrpDPort(group, dport, wildcard),
-                rcvdDur(rxStats.durationNanos()));
+                fmtGrpDPort(group, dport, wildcard), rcvdDur(duration));
         return;
     }
 
@@ -191,7 +344,7 @@ void fmtRxStats(
     std::vector<FlowStatsView> fsvs;
     fsvs.reserve(rxStats.size());
     rxStats.sortedForEach(
-            [&fsvs, duration=rxStats.durationNanos(),
+            [&fsvs, duration,
              &sourceFldLen, &dportFldLen, &pktsFldLen,
              &bytesFldLen, &apsFldLen, &rateFldLen]
             (auto source, auto sport, auto dport, auto const& fs){
@@ -216,8 +369,7 @@ void fmtRxStats(
 
     fmt::format_to(buf,
             "Traffic received for {} in {} sec\n",
-            fmtGrpDPort(group, dport, wildcard),
-            rcvdDur(rxStats.durationNanos()));
+            fmtGrpDPort(group, dport, wildcard), rcvdDur(duration));
 
     fmt::format_to(buf, fmtStr, 
             CapSource, CapDPort, CapPkts, CapBytes, CapAPS, CapRate);
@@ -230,14 +382,93 @@ void fmtRxStats(
         fmt::format_to(buf, fmtStr,
                 fsv.source, fsv.dport, fsv.packets,
                 fsv.bytes, fsv.aps, fsv.rate);
+
+    fmtLatencyStats(rxStats, buf);
+    fmtSeqStats(rxStats, buf);
+    fmtArrivalStats(rxStats, buf);
+}
+
+/**
+ * Lists the groups which received no traffic on a single line, which
+ * keeps the summary of thousands of mostly idle groups readable
+ */
+void fmtIdleGroups(
+        std::vector<net::IPv4Address> const& groups, std::size_t total,
+        uint dport, bool wildcard, uint64_t duration,
+        fmt::memory_buffer& buf) {
+    fmt::format_to(buf,
+            "No traffic received for {} of {} groups on UDP port {} "
+            "in {} sec:",
+            groups.size(), total,
+            wildcard ? "*" : fmt::format("{}", dport), rcvdDur(duration));
+    for (auto group: groups)
+        fmt::format_to(buf, " {}", group);
+    fmt::format_to(buf, "\n");
+}
+
+void fmtFilterStats(FilterStats const& fs, fmt::memory_buffer& buf) {
+    fmt::format_to(buf,
+            "Filtered by malt: {} packets, {} bytes "
+            "(kernel filter {})\n",
+            fs.pkts, fs.bytes, fs.kernelFilter ? "on" : "off");
+}
+
+void fmtBusyPollStats(BusyPollStats const& bps, fmt::memory_buffer& buf) {
+    uint64_t spins = bps.productiveSpins + bps.emptySpins;
+    double emptyPct = spins == 0 ? 0.0
+            : static_cast<double>(bps.emptySpins) * 100 / spins;
+    fmt::format_to(buf,
+            "Busy poll: {} spins, {} productive, {} empty ({:.2f}%)\n",
+            spins, bps.productiveSpins, bps.emptySpins, emptyPct);
+}
+
+void fmtWakeupStats(WakeupStats const& ws, fmt::memory_buffer& buf) {
+    if (ws.wakeups() == 0) return;
+
+    fmt::format_to(buf,
+            "Wakeups: {}, {:.2f} packets per wakeup\n",
+            ws.wakeups(), static_cast<double>(ws.pkts()) / ws.wakeups());
+
+    fmt::format_to(buf, "Packets per wakeup:");
+    for (unsigned b{0}; b < WakeupStats::Buckets; ++b) {
+        if (ws.bucket(b) == 0) continue;
+
+        if (b == 0) fmt::format_to(buf, " 0: {}", ws.bucket(b));
+        else if (b == 1) fmt::format_to(buf, " 1: {}", ws.bucket(b));
+        else if (b == WakeupStats::Buckets - 1)
+            fmt::format_to(buf, " {}+: {}", 1u << (b - 1), ws.bucket(b));
+        else fmt::format_to(buf,
+                " {}-{}: {}", 1u << (b - 1), (1u << b) - 1, ws.bucket(b));
+    }
+    fmt::format_to(buf, "\n");
+}
+
+/**
+ * Shows how evenly the flows were spread across the receiver threads
+ */
+void fmtWorkerPkts(
+        std::vector<uint64_t> const& workerPkts, fmt::memory_buffer& buf) {
+    uint64_t total{0};
+    for (auto pkts: workerPkts)
+        total += pkts;
+
+    fmt::format_to(buf, "Packets per thread:");
+    for (std::size_t w{0}; w < workerPkts.size(); ++w) {
+        double pct = total == 0 ? 0.0
+                : static_cast<double>(workerPkts[w]) * 100 / total;
+        fmt::format_to(buf, " {}: {} ({:.2f}%)", w, workerPkts[w], pct);
+    }
+    fmt::format_to(buf, "\n");
 }
 
 } // anon.namespace
 
-void OutputHandler::showTimeout(uint64_t ts) {
+void OutputHandler::showTimeout(uint64_t ts, net::IPv4Address group) {
     fmt::memory_buffer buf{};
     if (cfg_.colors()) fmt::format_to(buf, TERM_COLOR_WHITE_BRIGHT);
-    fmt::format_to(buf, "{:<12} timeout", strTs(ts));
+    if (cfg_.groups().size() == 1)
+        fmt::format_to(buf, "{:<12} timeout", strTs(ts));
+    else fmt::format_to(buf, "{:<12} timeout {}", strTs(ts), group);
     if (cfg_.colors()) fmt::format_to(buf, TERM_COLOR_RESET);
     fmt::print("{}\n", fmt::to_string(buf));
 }
@@ -248,6 +479,62 @@ void OutputHandler::showRcvdPacket(PacketInfo const& pinfo) {
     if (cfg_.showPayload()) showPayload(pinfo, cfg_.colors());
 }
 
+void OutputHandler::showDroppedLines(uint64_t ts, uint64_t dropped) {
+    fmt::memory_buffer buf{};
+    if (cfg_.colors()) fmt::format_to(buf, TERM_COLOR_WHITE_BRIGHT);
+    fmt::format_to(buf,
+            "{:<12} {} lines not shown, the output is too slow",
+            strTs(ts), dropped);
+    if (cfg_.colors()) fmt::format_to(buf, TERM_COLOR_RESET);
+    fmt::print("{}\n", fmt::to_string(buf));
+}
+
+void OutputHandler::showFlowSummary(FlowSummary const& fs) {
+    fmt::memory_buffer buf{};
+    if (cfg_.colors()) fmt::format_to(buf, TERM_COLOR_YELLOW_BRIGHT);
+    fmt::format_to(buf,
+            "{:<12} {}:{}->{}:{} TTL {}, {:.0f} pps, {}, avg size {}",
+            strTs(fs.timestamp),
+            fs.source, fs.sport, fs.group, fs.dport, fmtTtl(fs.ttl),
+            static_cast<double>(fs.pkts) * 1'000'000'000 / fs.durationNanos,
+            fmtRate(fs.bytes, fs.durationNanos), fs.bytes / fs.pkts);
+    if (cfg_.colors()) fmt::format_to(buf, TERM_COLOR_RESET);
+    fmt::print("{}\n", fmt::to_string(buf));
+}
+
+void OutputHandler::showLatencySummary(LatencySummary const& ls) {
+    fmt::memory_buffer buf{};
+    if (cfg_.colors()) fmt::format_to(buf, TERM_COLOR_YELLOW_BRIGHT);
+    fmt::format_to(buf,
+            "{:<12} {}:{}->{}:{} latency usec: {} samples, min {}, p50 {}, "
+            "p90 {}, p99 {}, p99.9 {}, max {}",
+            strTs(ls.timestamp),
+            ls.source, ls.sport, ls.group, ls.dport, ls.count,
+            fmtLatency(ls.minNs), fmtLatency(ls.p50Ns),
+            fmtLatency(ls.p90Ns), fmtLatency(ls.p99Ns),
+            fmtLatency(ls.p999Ns), fmtLatency(ls.maxNs));
+    if (cfg_.colors()) fmt::format_to(buf, TERM_COLOR_RESET);
+    fmt::print("{}\n", fmt::to_string(buf));
+}
+
+void OutputHandler::showSeqGap(SeqGap const& gap) {
+    fmt::memory_buffer buf{};
+    if (cfg_.colors()) fmt::format_to(buf, TERM_COLOR_WHITE_BRIGHT);
+    if (gap.count == 1)
+        fmt::format_to(buf,
+                "{:<12} {}:{}->{}:{} malt pkt seq #{} missing",
+                strTs(gap.timestamp), gap.source, gap.sport,
+                gap.group, gap.dport, gap.firstSeq);
+    else fmt::format_to(buf,
+                "{:<12} {}:{}->{}:{} malt pkt seq #{}-#{} missing, "
+                "{} packets",
+                strTs(gap.timestamp), gap.source, gap.sport,
+                gap.group, gap.dport, gap.firstSeq,
+                gap.firstSeq + gap.count - 1, gap.count);
+    if (cfg_.colors()) fmt::format_to(buf, TERM_COLOR_RESET);
+    fmt::print("{}\n", fmt::to_string(buf));
+}
+
 void OutputHandler::showSentPacket(MaltBeaconHdr const& hdr) {
     fmt::memory_buffer buf{};
     if (cfg_.colors()) fmt::format_to(buf, TERM_COLOR_RED_BRIGHT);
@@ -260,15 +547,103 @@ void OutputHandler::showSentPacket(MaltBeaconHdr const& hdr) {
 void OutputHandler::showRxStats(RxStats const& rxStats) {
     fmt::memory_buffer buf{};
     if (cfg_.colors()) fmt::format_to(buf, TERM_COLOR_YELLOW_BRIGHT);
-    fmtRxStats(cfg_.group(), cfg_.dport(), cfg_.wildcard(), rxStats, buf);
+    auto const& groups = cfg_.groups();
+    if (groups.size() == 1) {
+        fmtRxStats(groups.front(), cfg_.dport(), cfg_.wildcard(),
+                rxStats.group(0), rxStats.durationNanos(), buf);
+    } else {
+        std::vector<net::IPv4Address> idleGroups;
+        for (unsigned g{0}; g < groups.size(); ++g) {
+            if (rxStats.group(g).size() == 0) {
+                idleGroups.push_back(groups[g]);
+                continue;
+            }
+
+            fmtRxStats(groups[g], cfg_.dport(), cfg_.wildcard(),
+                    rxStats.group(g), rxStats.durationNanos(), buf);
+            fmt::format_to(buf, "\n");
+        }
+
+        if (! idleGroups.empty())
+            fmtIdleGroups(idleGroups, groups.size(),
+                    cfg_.dport(), cfg_.wildcard(),
+                    rxStats.durationNanos(), buf);
+    }
+
+    // The regular socket also filters the groups joined by the other
+    // processes on the host
+    if (cfg_.wildcard() || ! cfg_.sports().empty()
+        || rxStats.filterStats().pkts > 0)
+        fmtFilterStats(rxStats.filterStats(), buf);
+    if (cfg_.busyPoll())
+        fmtBusyPollStats(rxStats.busyPollStats(), buf);
+    else fmtWakeupStats(rxStats.wakeupStats(), buf);
+    if (rxStats.workerPkts().size() > 1)
+        fmtWorkerPkts(rxStats.workerPkts(), buf);
+    if (rxStats.droppedLines() > 0)
+        fmt::format_to(buf, "Lines not shown: {}\n", rxStats.droppedLines());
     if (cfg_.colors()) fmt::format_to(buf, TERM_COLOR_RESET);
     fmt::print("\n{}", fmt::to_string(buf));
 }
 
-void OutputHandler::showTxStats(uint64_t pktsSent) {
+void OutputHandler::showTxStats(TxStats const& txStats) {
     fmt::memory_buffer buf{};
     if (cfg_.colors()) fmt::format_to(buf, TERM_COLOR_RED_BOLD);
-    fmt::format_to(buf, "\nsent {} packets", pktsSent);
+    fmt::format_to(buf, "\nsent {} packets", txStats.pkts);
+    auto const& flows = cfg_.flows();
+    if (flows.size() > 1)
+        fmt::format_to(buf, " of {} flows", flows.size());
+
+    // The target is only known if all the flows are paced in the same
+    // unit and they all send for the same time, unlike the flows of
+    // different rates limited by the count
+    uint64_t target{0};
+    RateUnit unit = flows.front().rateUnit;
+    for (auto const& flow: flows) {
+        if (flow.rateUnit != unit) {
+            target = 0;
+            break;
+        }
+        target += flow.rate;
+    }
+
+    uint64_t duration = txStats.durationNanos;
+    if (duration > 0) {
+        fmt::format_to(buf, " in {} sec\nrate {}, {}", rcvdDur(duration),
+                fmtPktRate(txStats.pkts, duration),
+                fmtRate(txStats.bytes, duration));
+    }
+    if (cfg_.count() > 0 && flows.size() > 1)
+        target = 0;
+    if (duration > 0 && target > 0) {
+        bool pps = unit == RateUnit::Pps;
+        double achieved = pps
+                ? static_cast<double>(txStats.pkts)
+                : static_cast<double>(txStats.bytes << 3u);
+        achieved = achieved * 1'000'000'000 / duration;
+        fmt::format_to(buf, " ({:.2f}% of target {})",
+                achieved * 100 / target,
+                pps ? fmtPktRate(target, 1'000'000'000)
+                    : fmtRate(target, 8'000'000'000));
+    }
+    if (txStats.noBufs > 0)
+        fmt::format_to(buf, "\nENOBUFS: {} sends", txStats.noBufs);
+    if (txStats.missedDeadlines > 0)
+        fmt::format_to(buf, "\nmissed deadlines: {}, the packets were "
+                "not sent", txStats.missedDeadlines);
+    if (txStats.gsoSends > 0)
+        fmt::format_to(buf, "\nGSO: {} sends of {:.1f} packets on average",
+                txStats.gsoSends,
+                static_cast<double>(txStats.gsoPkts) / txStats.gsoSends);
+    if (txStats.txTimestamps > 0) {
+        fmt::format_to(buf, "\nTX timestamps: {}, offset from schedule "
+                "min/avg/max/stddev {:.1f}/{:.1f}/{:.1f}/{:.1f} usec",
+                txStats.txTimestamps,
+                txStats.minTxOffsetNs / 1000.0,
+                txStats.avgTxOffsetNs() / 1000.0,
+                txStats.maxTxOffsetNs / 1000.0,
+                txStats.stddevTxOffsetNs() / 1000.0);
+    }
     if (cfg_.colors()) fmt::format_to(buf, TERM_COLOR_RESET);
     fmt::print("{}\n", fmt::to_string(buf));
 }
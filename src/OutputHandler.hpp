@@ -8,6 +8,7 @@
 #include "PacketInfo.hpp"
 #include "Config.hpp"
 #include "RxStats.hpp"
+#include "TxStats.hpp"
 
 namespace malt {
 
@@ -16,15 +17,23 @@ public:
     explicit OutputHandler(Config const& cfg)
     : cfg_{cfg} {}
 
-    void showTimeout(uint64_t);
+    void showTimeout(uint64_t, net::IPv4Address group);
 
     void showRcvdPacket(PacketInfo const&);
 
+    void showDroppedLines(uint64_t, uint64_t dropped);
+
+    void showFlowSummary(FlowSummary const&);
+
+    void showLatencySummary(LatencySummary const&);
+
+    void showSeqGap(SeqGap const&);
+
     void showSentPacket(MaltBeaconHdr const&);
 
     void showRxStats(RxStats const&);
 
-    void showTxStats(uint64_t);
+    void showTxStats(TxStats const&);
 private:
     Config const& cfg_;
 };
@@ -1,9 +1,15 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
 #include "vdunlib/net/IPv4Address.hpp"
 
 constexpr int BufferSize{67584};
+// The number of the UDP payload bytes received if the payload is not
+// displayed, it is sufficient to decode the malt beacons
+constexpr int PayloadPrefixSize{128};
+// The max size of the IPv4 header
+constexpr int MaxIPv4HdrSize{60};
 
 namespace malt {
 
@@ -11,21 +17,63 @@ struct PacketInfo final {
     net::IPv4Address source;
     uint16_t sport;
     net::IPv4Address group;
+    // The index of the group in Config::groups()
+    unsigned groupIndex;
     uint16_t dport;
     // If ttl field is -1, it means the receiver was unable
     // to get the TTL value
     int16_t ttl;
-    // Unless packet display was requested or this packet was generated
-    // by MaltSender this field may contain garbage
-    uint8_t payload[BufferSize];
+    // Points to the payload in the buffer owned by the receiver policy,
+    // it is valid until the policy receives the next batch
+    uint8_t const* payload;
+    // The UDP payload size of the datagram, but only the first
+    // capturedSize bytes are available unless the payload display
+    // was requested
     unsigned payloadSize;
+    unsigned capturedSize;
+    // The kernel receive time in nanoseconds, if it is 0, the receiver
+    // policy was unable to get it and MaltReceiver uses the host time
     uint64_t timestamp;
 };
 
+/**
+ * Returns the number of the UDP payload bytes the receiver policies
+ * capture. The full payload is only needed if it is displayed,
+ * otherwise receiving just its beginning saves the memory bandwidth.
+ */
+constexpr unsigned payloadCaptureSize(bool fullPayload) {
+    return fullPayload ? BufferSize : PayloadPrefixSize;
+}
+
+/**
+ * A fixed capacity array of the packets received by a receiver
+ * policy in a single call. The packet slots are allocated once
+ * and reused for every subsequent batch.
+ */
+class PacketBatch final {
+public:
+    explicit PacketBatch(unsigned capacity)
+    : pinfos_{new PacketInfo[capacity]}, capacity_{capacity}, size_{0} {}
+
+    PacketInfo& operator[] (unsigned i) { return pinfos_[i]; }
+    PacketInfo const& operator[] (unsigned i) const { return pinfos_[i]; }
+
+    unsigned capacity() const { return capacity_; }
+    unsigned size() const { return size_; }
+    void resize(unsigned size) { size_ = size; }
+
+private:
+    std::unique_ptr<PacketInfo[]> pinfos_;
+    unsigned capacity_;
+    unsigned size_;
+};
+
 enum class ReceivedPacket {
     Accepted = 0,
     Filtered = 1,
-    Failed = 2
+    Failed = 2,
+    // Nothing to receive on the non-blocking socket
+    WouldBlock = 3
 };
 
-} // namespace malt
\ No newline at end of file
+} // namespace malt
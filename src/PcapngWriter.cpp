@@ -0,0 +1,254 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <linux/udp.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fmt/format.h>
+
+#include "AppUtils.hpp"
+#include "PcapngWriter.hpp"
+
+namespace malt {
+
+namespace {
+
+constexpr uint32_t SectionHeaderBlock{0x0a0d0d0a};
+constexpr uint32_t InterfaceDescriptionBlock{1};
+constexpr uint32_t EnhancedPacketBlock{6};
+constexpr uint32_t ByteOrderMagic{0x1a2b3c4d};
+// The packets start with the IPv4 header
+constexpr uint16_t LinkTypeRaw{101};
+constexpr uint16_t OptEndOfOpt{0};
+constexpr uint16_t OptIfTsResol{9};
+// The timestamps are in nanoseconds
+constexpr uint8_t TsResolNanos{9};
+
+constexpr std::size_t IPv4UdpHdrSize{sizeof(iphdr) + sizeof(udphdr)};
+
+struct SectionHeader final {
+    uint32_t type;
+    uint32_t length;
+    uint32_t byteOrderMagic;
+    uint16_t major;
+    uint16_t minor;
+    int64_t sectionLength;
+    uint32_t trailingLength;
+} __attribute__((packed));
+
+struct InterfaceDescription final {
+    uint32_t type;
+    uint32_t length;
+    uint16_t linkType;
+    uint16_t reserved;
+    uint32_t snapLen;
+    uint16_t tsResolCode;
+    uint16_t tsResolLength;
+    uint8_t tsResol;
+    uint8_t tsResolPadding[3];
+    uint16_t endOfOptCode;
+    uint16_t endOfOptLength;
+    uint32_t trailingLength;
+} __attribute__((packed));
+
+struct EnhancedPacketHeader final {
+    uint32_t type;
+    uint32_t length;
+    uint32_t interfaceId;
+    uint32_t tsHigh;
+    uint32_t tsLow;
+    uint32_t capturedLength;
+    uint32_t originalLength;
+} __attribute__((packed));
+
+constexpr std::size_t pad4(std::size_t size) { return (size + 3) & ~3ul; }
+
+uint16_t ipChecksum(iphdr const& ip) {
+    auto words = reinterpret_cast<uint16_t const*>(&ip);
+    uint32_t sum{0};
+    for (std::size_t i{0}; i < sizeof(ip) / 2; ++i)
+        sum += words[i];
+    while (sum >> 16u)
+        sum = (sum & 0xffffu) + (sum >> 16u);
+    return static_cast<uint16_t>(~sum);
+}
+
+} // anon.namespace
+
+PcapngWriter::PcapngWriter(Config const& cfg, unsigned worker)
+: cfg_{cfg}
+, worker_{worker}
+, snapLen_{static_cast<uint32_t>(
+        IPv4UdpHdrSize + payloadCaptureSize(cfg.showPayload()))}
+, seq_{0}
+, fd_{-1}
+, map_{nullptr}
+, used_{0}
+, rotateNs_{0}
+, pkts_{0} {}
+
+bool PcapngWriter::write(PacketInfo const& pinfo) {
+    uint64_t interval =
+            static_cast<uint64_t>(cfg_.writeInterval()) * 1'000'000'000;
+    if (interval > 0) {
+        if (rotateNs_ == 0)
+            rotateNs_ = pinfo.timestamp + interval;
+        else if (pinfo.timestamp >= rotateNs_) {
+            if (! openFile(seq_ + 1))
+                return false;
+            rotateNs_ = pinfo.timestamp + interval;
+        }
+    }
+
+    auto captured = std::min<std::size_t>(
+            IPv4UdpHdrSize + pinfo.capturedSize, snapLen_);
+    std::size_t blockLen =
+            sizeof(EnhancedPacketHeader) + pad4(captured) + sizeof(uint32_t);
+    if (used_ + blockLen > cfg_.writeSize() && ! openFile(seq_ + 1))
+        return false;
+
+    EnhancedPacketHeader eph{};
+    eph.type = EnhancedPacketBlock;
+    eph.length = static_cast<uint32_t>(blockLen);
+    eph.tsHigh = static_cast<uint32_t>(pinfo.timestamp >> 32u);
+    eph.tsLow = static_cast<uint32_t>(pinfo.timestamp);
+    eph.capturedLength = static_cast<uint32_t>(captured);
+    eph.originalLength =
+            static_cast<uint32_t>(IPv4UdpHdrSize + pinfo.payloadSize);
+    append(&eph, sizeof(eph));
+
+    iphdr ip{};
+    ip.version = 4;
+    ip.ihl = sizeof(ip) / 4;
+    ip.tot_len = htons(static_cast<uint16_t>(eph.originalLength));
+    ip.ttl = pinfo.ttl == -1 ? 0 : static_cast<uint8_t>(pinfo.ttl);
+    ip.protocol = IPPROTO_UDP;
+    ip.saddr = pinfo.source.to_nl();
+    ip.daddr = pinfo.group.to_nl();
+    ip.check = ipChecksum(ip);
+    append(&ip, sizeof(ip));
+
+    // The checksum is optional for UDP over IPv4
+    udphdr udp{};
+    udp.source = htons(pinfo.sport);
+    udp.dest = htons(pinfo.dport);
+    udp.len = htons(static_cast<uint16_t>(sizeof(udp) + pinfo.payloadSize));
+    append(&udp, sizeof(udp));
+
+    append(pinfo.payload, captured - IPv4UdpHdrSize);
+    // The padding and the options are zero as is the preallocated file
+    used_ += pad4(captured) - captured;
+    append(&eph.length, sizeof(eph.length));
+
+    ++pkts_;
+    return true;
+}
+
+std::string PcapngWriter::fileName(unsigned seq) const {
+    std::string const& path = cfg_.writeFile();
+    auto slash = path.rfind('/');
+    auto dot = path.rfind('.');
+    if (dot == std::string::npos || dot == 0
+        || (slash != std::string::npos && dot < slash + 2))
+        dot = path.size();
+
+    std::string suffix;
+    if (cfg_.threads() > 1)
+        suffix += fmt::format(".t{}", worker_);
+    if (seq > 0)
+        suffix += fmt::format(".{}", seq);
+
+    return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+bool PcapngWriter::openFile(unsigned seq) {
+    close();
+    seq_ = seq;
+
+    std::string name = fileName(seq);
+    fd_ = ::open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ == -1)
+        return error("cannot create capture file ", name, ": ",
+                     sysError(errno));
+
+    // The blocks must be allocated upfront, a store into a page of
+    // a sparse mapping without a block left on the disk raises SIGBUS.
+    // glibc emulates the allocation on the file systems lacking it, thus
+    // a failure means that the disk is full or the file too large.
+    auto size = static_cast<off_t>(cfg_.writeSize());
+    int rc = posix_fallocate(fd_, 0, size);
+    if (rc != 0)
+        return error("cannot preallocate capture file ", name, ": ",
+                     sysError(rc));
+
+    void* map = mmap(nullptr, cfg_.writeSize(),
+                     PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED)
+        return error("cannot map capture file ", name, ": ",
+                     sysError(errno));
+
+    map_ = static_cast<uint8_t*>(map);
+    madvise(map_, cfg_.writeSize(), MADV_SEQUENTIAL);
+
+    writeHeaderBlocks();
+    return true;
+}
+
+void PcapngWriter::close() {
+    if (map_ != nullptr) {
+        munmap(map_, cfg_.writeSize());
+        map_ = nullptr;
+    }
+
+    if (fd_ != -1) {
+        if (ftruncate(fd_, static_cast<off_t>(used_)) == -1)
+            warning("cannot truncate capture file ", fileName(seq_),
+                    ": ", sysError(errno));
+
+        int rc;
+        do {
+            rc = ::close(fd_);
+        } while (rc == -1 && errno == EINTR);
+        fd_ = -1;
+    }
+
+    used_ = 0;
+}
+
+void PcapngWriter::append(void const* data, std::size_t size) {
+    memcpy(map_ + used_, data, size);
+    used_ += size;
+}
+
+void PcapngWriter::writeHeaderBlocks() {
+    SectionHeader shb{};
+    shb.type = SectionHeaderBlock;
+    shb.length = sizeof(shb);
+    shb.byteOrderMagic = ByteOrderMagic;
+    shb.major = 1;
+    shb.minor = 0;
+    // The section length is not known in advance
+    shb.sectionLength = -1;
+    shb.trailingLength = sizeof(shb);
+    append(&shb, sizeof(shb));
+
+    InterfaceDescription idb{};
+    idb.type = InterfaceDescriptionBlock;
+    idb.length = sizeof(idb);
+    idb.linkType = LinkTypeRaw;
+    idb.snapLen = snapLen_;
+    idb.tsResolCode = OptIfTsResol;
+    idb.tsResolLength = 1;
+    idb.tsResol = TsResolNanos;
+    idb.endOfOptCode = OptEndOfOpt;
+    idb.endOfOptLength = 0;
+    idb.trailingLength = sizeof(idb);
+    append(&idb, sizeof(idb));
+}
+
+} // namespace malt
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "PacketInfo.hpp"
+#include "Config.hpp"
+
+namespace malt {
+
+/**
+ * Writes the accepted packets of a receiver worker into pcapng files.
+ * Each file is preallocated to Config::writeSize() bytes and memory
+ * mapped, thus a packet is written by copying it into the mapping
+ * without a system call. The file is truncated to the written size
+ * when it is closed.
+ *
+ * The policies pass only the UDP payload up, thus every packet is
+ * written as a raw IPv4 packet whose IPv4 and UDP headers are rebuilt
+ * from the packet info. Unless the payload is displayed, only the
+ * captured payload prefix is written, which is also the snap length
+ * recorded in the file.
+ *
+ * A new file is started once the packet doesn't fit into the current
+ * one or the rotation interval has passed. The files of the worker are
+ * named after Config::writeFile() with the worker index, if there are
+ * several workers, and the file sequence number, except for the first
+ * file, inserted before the extension.
+ */
+class PcapngWriter final {
+public:
+    PcapngWriter(Config const& cfg, unsigned worker);
+
+    PcapngWriter(PcapngWriter const&) = delete;
+    PcapngWriter& operator= (PcapngWriter const&) = delete;
+
+    ~PcapngWriter() { close(); }
+
+    bool open() { return openFile(0); }
+
+    /**
+     * @return false if the packet could not be written
+     */
+    bool write(PacketInfo const& pinfo);
+
+    uint64_t pkts() const { return pkts_; }
+
+private:
+    Config const& cfg_;
+    unsigned worker_;
+    uint32_t snapLen_;
+    unsigned seq_;
+    int fd_;
+    uint8_t* map_;
+    std::size_t used_;
+    uint64_t rotateNs_;
+    uint64_t pkts_;
+
+    std::string fileName(unsigned seq) const;
+
+    bool openFile(unsigned seq);
+
+    void close();
+
+    void append(void const* data, std::size_t size);
+
+    void writeHeaderBlocks();
+};
+
+} // namespace malt
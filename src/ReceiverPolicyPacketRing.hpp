@@ -0,0 +1,262 @@
+#pragma once
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/udp.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstring>
+
+#include "PacketInfo.hpp"
+#include "AppUtils.hpp"
+#include "Config.hpp"
+#include "IPv4UdpParser.hpp"
+#include "BpfFilter.hpp"
+#include "RxStats.hpp"
+
+namespace malt {
+
+/**
+ * Receives the IPv4 packets of the multicast interface through a memory
+ * mapped TPACKET_V3 ring of an AF_PACKET socket. The kernel fills the
+ * ring blocks with frames and hands each block over to malt once it is
+ * full or its retire timeout expires. The frames are parsed in place,
+ * the payloads of the packet batch point into the ring block and the
+ * whole block is returned to the kernel only after the batch has been
+ * processed. The packets are timestamped with the kernel receive time
+ * recorded in their frame headers.
+ *
+ * AF_PACKET sockets can't join multicast groups, thus the join is sent
+ * from an auxiliary UDP socket of the first worker which never receives
+ * anything.
+ *
+ * If there are several workers, each has its own ring and the sockets
+ * of the rings join a PACKET_FANOUT group, which spreads the packets
+ * across them in the configured mode.
+ *
+ * Unless disabled, the packets not destined for the group are discarded
+ * by a filter program in the kernel. The socket is opened without
+ * a protocol and starts receiving only when it is bound after the
+ * filter is attached. Unless the payload is displayed, the filter
+ * also makes the kernel copy only the headers and the payload prefix
+ * needed to decode the malt beacons into the ring.
+ */
+class ReceiverPolicyPacketRing final {
+    static constexpr unsigned BlockSize{1u << 20u};
+    static constexpr unsigned BlockCount{32};
+    static constexpr unsigned FrameSize{2048};
+    static constexpr unsigned BlockRetireTimeoutMs{10};
+
+public:
+    ReceiverPolicyPacketRing(Config const& cfg, unsigned worker)
+    : cfg_{cfg}
+    , worker_{worker}
+    , batch_{BlockSize / TPACKET_ALIGN(TPACKET3_HDRLEN)}
+    , joinS_{-1}
+    , ring_{nullptr}
+    , block_{0}
+    , loopback_{false}
+    , filterStats_{} {}
+
+    ReceiverPolicyPacketRing(ReceiverPolicyPacketRing const&) = delete;
+    ReceiverPolicyPacketRing& operator= (
+            ReceiverPolicyPacketRing const&) = delete;
+
+    ~ReceiverPolicyPacketRing() {
+        if (ring_ != nullptr)
+            munmap(ring_, static_cast<size_t>(BlockSize) * BlockCount);
+
+        if (joinS_ != -1) {
+            int rc;
+            do {
+                rc = close(joinS_);
+            } while (rc == -1 && errno == EINTR);
+        }
+    }
+
+    int openSocket() {
+        if (worker_ == 0) {
+            joinS_ = socket(AF_INET, SOCK_DGRAM, 0);
+            if (joinS_ == -1) {
+                sysCallError("unable to create socket");
+                return -1;
+            }
+        }
+
+        int s = socket(AF_PACKET, SOCK_DGRAM, 0);
+
+        if (s == -1) {
+            if (errno == EPERM)
+                error("permission to open packet socket denied by host");
+            else sysCallError("unable to create packet socket");
+        }
+
+        return s;
+    }
+
+    bool configureSocket(int s) {
+        if (cfg_.kernelFilter())
+            filterStats_.kernelFilter = attachFilter(s, makeUdpFilter(
+                    cfg_, cfg_.showPayload() ? FullSnapLen
+                    : MaxIPv4HdrSize + sizeof(udphdr) + PayloadPrefixSize));
+
+        int version = TPACKET_V3;
+        if (setsockopt(s, SOL_PACKET,
+                PACKET_VERSION, &version, sizeof(version)) == -1)
+            return sysCallError("cannot set TPACKET_V3 packet ring version");
+
+        tpacket_req3 req{};
+        req.tp_block_size = BlockSize;
+        req.tp_block_nr = BlockCount;
+        req.tp_frame_size = FrameSize;
+        req.tp_frame_nr = BlockSize / FrameSize * BlockCount;
+        req.tp_retire_blk_tov = BlockRetireTimeoutMs;
+
+        if (setsockopt(s, SOL_PACKET,
+                PACKET_RX_RING, &req, sizeof(req)) == -1)
+            return sysCallError("cannot create packet ring");
+
+        void* ring = mmap(
+                nullptr, static_cast<size_t>(BlockSize) * BlockCount,
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, s, 0);
+        if (ring == MAP_FAILED)
+            return sysCallError("cannot map packet ring");
+
+        ring_ = static_cast<uint8_t*>(ring);
+        return true;
+    }
+
+    bool bindSocket(int s) {
+        ifreq ifr{};
+        strncpy(ifr.ifr_name, cfg_.intf().c_str(), sizeof(ifr.ifr_name) - 1);
+        if (ioctl(s, SIOCGIFINDEX, &ifr) == -1)
+            return error("cannot get index of interface ",
+                         cfg_.intf(), ": ", sysError(errno));
+
+        sockaddr_ll sll{};
+        sll.sll_family = AF_PACKET;
+        sll.sll_protocol = htons(ETH_P_IP);
+        sll.sll_ifindex = ifr.ifr_ifindex;
+
+        if (ioctl(s, SIOCGIFFLAGS, &ifr) == -1)
+            return error("cannot get flags of interface ",
+                         cfg_.intf(), ": ", sysError(errno));
+        loopback_ = (ifr.ifr_flags & IFF_LOOPBACK) != 0;
+
+        if (bind(s, reinterpret_cast<sockaddr*>(&sll), sizeof(sll)) == -1)
+            return error("cannot bind packet socket to interface ",
+                         cfg_.intf(), ": ", sysError(errno));
+
+        if (cfg_.threads() > 1)
+            return joinFanout(s);
+
+        return true;
+    }
+
+    // Only called for the first worker
+    int membershipSocket(int) const { return joinS_; }
+
+    int pollFd(int s) const { return s; }
+
+    ReceivedPacket receivePackets(int) {
+        batch_.resize(0);
+
+        auto desc = currentBlock();
+        if ((desc->hdr.bh1.block_status & TP_STATUS_USER) == 0)
+            return ReceivedPacket::WouldBlock;
+
+        // Make sure the frames are read only after the block status
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        unsigned n{0};
+        auto frame = reinterpret_cast<uint8_t*>(desc)
+                + desc->hdr.bh1.offset_to_first_pkt;
+        for (uint32_t i{0}; i < desc->hdr.bh1.num_pkts; ++i) {
+            auto hdr = reinterpret_cast<tpacket3_hdr*>(frame);
+            frame += hdr->tp_next_offset;
+
+            // On the loopback interface every packet is seen twice,
+            // once when it is sent and once when it is received
+            auto sll = reinterpret_cast<sockaddr_ll*>(
+                    reinterpret_cast<uint8_t*>(hdr)
+                    + TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+            if (loopback_ && sll->sll_pkttype == PACKET_OUTGOING)
+                continue;
+
+            uint64_t pktTs =
+                    static_cast<uint64_t>(hdr->tp_sec) * 1'000'000'000ul
+                    + hdr->tp_nsec;
+            auto ipOffset = hdr->tp_net - hdr->tp_mac;
+            if (parseIPv4Udp(
+                    reinterpret_cast<uint8_t*>(hdr) + hdr->tp_net,
+                    hdr->tp_snaplen - ipOffset, hdr->tp_len - ipOffset,
+                    cfg_, batch_[n], pktTs) == ReceivedPacket::Accepted)
+                batch_[n++].timestamp = pktTs;
+            else filterStats_.add(hdr->tp_len - ipOffset);
+        }
+
+        if (n == 0) {
+            releaseBatch();
+            return ReceivedPacket::Filtered;
+        }
+
+        batch_.resize(n);
+        return ReceivedPacket::Accepted;
+    }
+
+    PacketBatch& batch() { return batch_; }
+
+    /**
+     * Returns the block the last batch points into back to the kernel
+     */
+    void releaseBatch() {
+        std::atomic_thread_fence(std::memory_order_release);
+        currentBlock()->hdr.bh1.block_status = TP_STATUS_KERNEL;
+        block_ = (block_ + 1) % BlockCount;
+    }
+
+    FilterStats const& filterStats() const { return filterStats_; }
+
+private:
+    Config const& cfg_;
+    unsigned worker_;
+    PacketBatch batch_;
+    int joinS_;
+    uint8_t* ring_;
+    unsigned block_;
+    bool loopback_;
+    FilterStats filterStats_;
+
+    /**
+     * Joins the fanout group of the process, which must be done once
+     * the socket is bound. In the hash mode the fragments are
+     * reassembled first, otherwise they would be hashed apart.
+     */
+    bool joinFanout(int s) {
+        int mode{PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG};
+        if (cfg_.fanout() == FanoutMode::Cpu)
+            mode = PACKET_FANOUT_CPU;
+        else if (cfg_.fanout() == FanoutMode::RoundRobin)
+            mode = PACKET_FANOUT_LB;
+
+        int fanout = (getpid() & 0xffff) | (mode << 16);
+        if (setsockopt(s, SOL_PACKET,
+                PACKET_FANOUT, &fanout, sizeof(fanout)) == -1)
+            return sysCallError("cannot join packet fanout group");
+
+        return true;
+    }
+
+    tpacket_block_desc* currentBlock() const {
+        return reinterpret_cast<tpacket_block_desc*>(
+                ring_ + static_cast<size_t>(block_) * BlockSize);
+    }
+};
+
+} // namespace malt
@@ -3,19 +3,50 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
-#include <linux/ip.h>
 #include <linux/udp.h>
+#include <algorithm>
 #include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "vdunlib/time/Time.hpp"
 
 #include "PacketInfo.hpp"
 #include "AppUtils.hpp"
 #include "Config.hpp"
+#include "IPv4UdpParser.hpp"
+#include "BpfFilter.hpp"
+#include "RxStats.hpp"
+#include "SocketUtils.hpp"
 
 namespace malt {
 
-struct ReceiverPolicyRaw final {
+/**
+ * Receives all the UDP datagrams destined for the host from a raw
+ * socket and accepts only those matching the config. Unless the payload
+ * is displayed, only the headers and the payload prefix needed to
+ * decode the malt beacons are received and MSG_TRUNC makes the kernel
+ * report the full packet size.
+ */
+class ReceiverPolicyRaw final {
+    struct alignas(cmsghdr) CmsgBuf {
+        uint8_t data[CMSG_SPACE(sizeof(timespec))];
+    };
+
+public:
+    ReceiverPolicyRaw(Config const& cfg, unsigned)
+    : cfg_{cfg}, batch_{1}
+    , buf_(MaxIPv4HdrSize + sizeof(udphdr)
+           + payloadCaptureSize(cfg.showPayload()))
+    , iov_{}, msg_{}, cmsgBuf_{}, filterStats_{} {
+        iov_.iov_base = buf_.data();
+        iov_.iov_len = buf_.size();
+        msg_.msg_iov = &iov_;
+        msg_.msg_iovlen = 1;
+        msg_.msg_control = cmsgBuf_.data;
+    }
 
-    static int openSocket() {
+    int openSocket() {
         int s = socket(AF_INET, SOCK_RAW, IPPROTO_UDP);
 
         if (s == -1) {
@@ -28,89 +59,87 @@ struct ReceiverPolicyRaw final {
         return s;
     }
 
-    static bool configureSocket(int) { return true; }
+    /**
+     * The raw socket receives every UDP datagram destined for the host,
+     * thus unless disabled a filter program is attached to the socket
+     * to discard the packets not destined for the group in the kernel.
+     */
+    bool configureSocket(int s) {
+        if (cfg_.kernelFilter())
+            filterStats_.kernelFilter = attachFilter(s, makeUdpFilter(cfg_));
+
+        enableRxTimestamps(s);
+        return true;
+    }
+
+    bool bindSocket(int s) { return bindUdpPort(s, cfg_.dport()); }
+
+    int membershipSocket(int s) const { return s; }
+
+    int pollFd(int s) const { return s; }
+
+    ReceivedPacket receivePackets(int s) {
+        batch_.resize(0);
+        auto rp = receivePacket(s, batch_[0]);
+        if (rp == ReceivedPacket::Accepted)
+            batch_.resize(1);
+        return rp;
+    }
+
+    PacketBatch& batch() { return batch_; }
+
+    void releaseBatch() {}
+
+    FilterStats const& filterStats() const { return filterStats_; }
+
+private:
+    Config const& cfg_;
+    PacketBatch batch_;
+    // The payload of the received packet points into this buffer
+    std::vector<uint8_t> buf_;
+    iovec iov_;
+    msghdr msg_;
+    CmsgBuf cmsgBuf_;
+    FilterStats filterStats_;
 
-    static ReceivedPacket receivePacket(
-            int s, PacketInfo& pinfo, Config const& cfg, uint64_t pktTs) {
-        uint8_t buf[BufferSize];
-        ssize_t rv = recv(s, buf, sizeof(buf), 0);
+    ReceivedPacket receivePacket(int s, PacketInfo& pinfo) {
+        msg_.msg_controllen = sizeof(cmsgBuf_);
+        ssize_t rv = recvmsg(s, &msg_, MSG_TRUNC);
 
         if (rv == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return ReceivedPacket::WouldBlock;
+
             sysCallError("failed to read UDP packet");
             return ReceivedPacket::Failed;
         }
 
+        pinfo.timestamp = 0;
+        for (auto cmsg_ptr = CMSG_FIRSTHDR(&msg_);
+             cmsg_ptr != nullptr;
+             cmsg_ptr = CMSG_NXTHDR(&msg_, cmsg_ptr)) {
+            if (auto ts = rxTimestamp(cmsg_ptr))
+                pinfo.timestamp = ts;
+        }
+        // This is only used to report malformed packets
+        uint64_t pktTs = pinfo.timestamp != 0
+                ? pinfo.timestamp : TimeUtils::gethostnanos();
+
         if (rv == 0) {
+            filterStats_.add(0);
             warningTs(pktTs, "no data received");
             return ReceivedPacket::Filtered;
         }
 
         auto rcvSize = static_cast<size_t>(rv);
-        // Make sure the IP header fits into the received packet data,
-        // but this should never fail
-        if (rcvSize < sizeof(iphdr)) {
-            warningTs(pktTs,
-                    "received packet size ", rcvSize,
-                    " is smaller than the minimal IP header size (",
-                    sizeof(iphdr), ")");
-            return ReceivedPacket::Filtered;
-        }
-        auto ipHdr = reinterpret_cast<iphdr*>(buf);
-
-        // Make sure this packet is destined for the multicast group we're
-        // interested in
-        if (ipHdr->daddr != cfg.group().to_nl())
-            return ReceivedPacket::Filtered;
-
-        auto ipHdrLen = static_cast<uint16_t>(ipHdr->ihl) << 2u;
-        auto udpPayloadOffset = ipHdrLen + sizeof(udphdr);
-        // Make sure there is enough room for the UDP header and payload
-        if (udpPayloadOffset > rcvSize) {
-            warningTs(pktTs,
-                    "UDP payload offset ", udpPayloadOffset,
-                    " is outside of the received packet size ", rcvSize,
-                    " (IP header len = ", ipHdrLen, ")");
-            return ReceivedPacket::Filtered;
-        }
-
-        // The multicast group is prepopulated the by MaltReceiver
-        // pinfo_.group = cfg_.group();
-        pinfo.source = net::IPv4Address::from_nl(ipHdr->saddr);
-        pinfo.ttl = static_cast<int16_t>(ipHdr->ttl);
-
-        auto udpHdr = reinterpret_cast<udphdr*>(buf + ipHdrLen);
-        pinfo.sport = ntohs(udpHdr->source);
-        pinfo.dport = ntohs(udpHdr->dest);
-        // This value maybe 0
-        pinfo.payloadSize =
-                static_cast<size_t>(ntohs(udpHdr->len)) - sizeof(udphdr);
-
-        // This is a sanity check for the return value of recv()
-        // vs the UDP payload size in the UDP header
-        if (udpPayloadOffset + pinfo.payloadSize != rcvSize) {
-            if (udpPayloadOffset + pinfo.payloadSize < rcvSize) {
-                warningTs(pktTs,
-                        "UDP datagram ", pinfo.source, ':',
-                        pinfo.sport, " -> ",
-                        pinfo.group, ':', pinfo.dport,
-                        " has extraneous bytes (recv size = ",
-                        rcvSize - udpPayloadOffset,
-                        ", UDP size = ", pinfo.payloadSize, ')');
-            } else {
-                warningTs(pktTs,
-                        "size of UDP datagram ", pinfo.source, ':',
-                        pinfo.sport, " -> ",
-                        pinfo.group, ':', pinfo.dport,
-                        " is not suffient for UDP payload (recv size = ",
-                        rcvSize - udpPayloadOffset,
-                        ", UDP size = ", pinfo.payloadSize, ')');
-                pinfo.payloadSize = rcvSize - udpPayloadOffset;
-            }
-        }
+        auto rp = parseIPv4Udp(
+                buf_.data(), std::min(rcvSize, buf_.size()), rcvSize,
+                cfg_, pinfo, pktTs);
+        if (rp == ReceivedPacket::Filtered)
+            filterStats_.add(rcvSize);
 
-        memcpy(pinfo.payload, buf + udpPayloadOffset, pinfo.payloadSize);
-        return ReceivedPacket::Accepted;
+        return rp;
     }
 };
 
-} // namespace malt
\ No newline at end of file
+} // namespace malt
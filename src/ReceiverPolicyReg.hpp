@@ -5,16 +5,64 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
 
 #include "PacketInfo.hpp"
 #include "AppUtils.hpp"
 #include "Config.hpp"
+#include "BpfFilter.hpp"
+#include "SocketUtils.hpp"
+#include "RxStats.hpp"
 
 namespace malt {
 
-struct ReceiverPolicyReg final {
+/**
+ * Receives the UDP datagrams from a regular UDP socket in batches
+ * of up to Config::batch() datagrams per recvmmsg() call. The message
+ * headers, the sender addresses and the TTL, destination address and
+ * timestamp control buffers are allocated once per slot and only the
+ * fields the kernel overwrites are reset before each call. The socket
+ * receives the port's datagrams of every group joined on the host, thus
+ * the datagrams destined for the groups not configured are dropped from
+ * the batch as are those sent from the source ports not configured.
+ *
+ * Unless the payload is displayed, each slot receives only the payload
+ * prefix needed to decode the malt beacons and MSG_TRUNC makes the
+ * kernel report the full datagram size.
+ *
+ * If several workers receive the same port, every socket gets a copy of
+ * each multicast datagram, thus each socket filters its shard of the
+ * flows in the kernel.
+ */
+class ReceiverPolicyReg final {
+public:
+    ReceiverPolicyReg(Config const& cfg, unsigned worker)
+    : cfg_{cfg}
+    , worker_{worker}
+    , batch_{cfg.batch()}
+    , captureSize_{payloadCaptureSize(cfg.showPayload())}
+    , bufs_(static_cast<std::size_t>(cfg.batch()) * captureSize_)
+    , msgs_(cfg.batch())
+    , iovs_(cfg.batch())
+    , senders_(cfg.batch())
+    , cmsgBufs_(cfg.batch())
+    , filterStats_{} {
+        for (unsigned i{0}; i < batch_.capacity(); ++i) {
+            iovs_[i].iov_base =
+                    bufs_.data() + static_cast<std::size_t>(i) * captureSize_;
+            iovs_[i].iov_len = captureSize_;
 
-    static int openSocket() {
+            msghdr& msg = msgs_[i].msg_hdr;
+            msg.msg_name = &senders_[i];
+            msg.msg_iov = &iovs_[i];
+            msg.msg_iovlen = 1;
+            msg.msg_control = cmsgBufs_[i].data;
+        }
+    }
+
+    int openSocket() {
         int s = socket(AF_INET, SOCK_DGRAM, 0);
 
         if (s == -1)
@@ -23,56 +71,95 @@ struct ReceiverPolicyReg final {
         return s;
     }
 
-    static bool configureSocket(int s) {
-        int ttl = 1;
-        if (setsockopt(s, IPPROTO_IP, IP_RECVTTL, &ttl, sizeof(ttl)) == -1)
-            return sysCallError("cannot enable receiving TTL");
+    bool configureSocket(int s) {
+        if (! enableUdpRxInfo(s))
+            return false;
+
+        if (cfg_.threads() > 1
+            && ! attachFilter(s, makeShardFilter(worker_, cfg_.threads())))
+            return error("unable to shard the flows across the threads");
+
+        enableRxTimestamps(s);
         return true;
     }
 
-    static ReceivedPacket receivePacket(
-            int s, PacketInfo& pinfo, Config const& cfg, uint64_t) {
-        iovec iov;
-        iov.iov_base = pinfo.payload;
-        iov.iov_len = sizeof(pinfo.payload);
-        size_t cmsgSize = sizeof(cmsghdr) + sizeof(int16_t);
-        uint8_t cmsgBuf[CMSG_SPACE(cmsgSize)];
-        sockaddr_in sender;
-        memset(&sender, 0, sizeof(sender));
-        msghdr msg;
-        memset(&msg, 0, sizeof(msg));
-        msg.msg_name = &sender;
-        msg.msg_namelen = sizeof(sender);
-        msg.msg_iov = &iov;
-        msg.msg_iovlen = 1;
-        msg.msg_control = cmsgBuf;
-        msg.msg_controllen = sizeof(cmsgBuf);
-
-        ssize_t recvMsgSize = recvmsg(s, &msg, 0);
-
-        if (recvMsgSize == -1) {
-            sysCallError("unable to receive packet");
+    bool bindSocket(int s) { return bindUdpPort(s, cfg_.dport()); }
+
+    int membershipSocket(int s) const { return s; }
+
+    int pollFd(int s) const { return s; }
+
+    ReceivedPacket receivePackets(int s) {
+        for (auto& mmsg: msgs_) {
+            mmsg.msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            mmsg.msg_hdr.msg_controllen = sizeof(UdpCmsgBuf);
+        }
+
+        int rv = recvmmsg(
+                s, msgs_.data(), batch_.capacity(), MSG_TRUNC, nullptr);
+
+        if (rv == -1) {
+            batch_.resize(0);
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return ReceivedPacket::WouldBlock;
+
+            sysCallError("unable to receive packets");
             return ReceivedPacket::Failed;
         }
 
-        pinfo.payloadSize = static_cast<unsigned>(recvMsgSize);
-
-        pinfo.ttl = -1;
-        for (auto cmsg_ptr = CMSG_FIRSTHDR(&msg);
-             cmsg_ptr != nullptr;
-             cmsg_ptr = CMSG_NXTHDR(&msg, cmsg_ptr)) {
-            if (cmsg_ptr->cmsg_level == IPPROTO_IP
-                && cmsg_ptr->cmsg_type == IP_TTL
-                && cmsg_ptr->cmsg_len > 0) {
-                auto p = static_cast<void *>(CMSG_DATA(cmsg_ptr));
-                pinfo.ttl = *static_cast<int16_t *>(p);
+        auto rcvd = static_cast<unsigned>(rv);
+        unsigned n{0};
+        for (unsigned i{0}; i < rcvd; ++i) {
+            if (! cfg_.sportAllowed(ntohs(senders_[i].sin_port))
+                || ! fillPacketInfo(msgs_[i], senders_[i], batch_[n])) {
+                filterStats_.add(msgs_[i].msg_len);
+                continue;
             }
+
+            ++n;
         }
 
-        pinfo.dport = cfg.dport();
+        batch_.resize(n);
+        return n > 0 ? ReceivedPacket::Accepted : ReceivedPacket::Filtered;
+    }
+
+    PacketBatch& batch() { return batch_; }
+
+    void releaseBatch() {}
+
+    FilterStats const& filterStats() const { return filterStats_; }
+
+private:
+    Config const& cfg_;
+    unsigned worker_;
+    PacketBatch batch_;
+    unsigned captureSize_;
+    std::vector<uint8_t> bufs_;
+    std::vector<mmsghdr> msgs_;
+    std::vector<iovec> iovs_;
+    std::vector<sockaddr_in> senders_;
+    std::vector<UdpCmsgBuf> cmsgBufs_;
+    FilterStats filterStats_;
+
+    /**
+     * @return false if the datagram is not destined for a configured
+     * group, true otherwise
+     */
+    bool fillPacketInfo(
+            mmsghdr& mmsg, sockaddr_in const& sender, PacketInfo& pinfo) {
+        pinfo.payload = static_cast<uint8_t const*>(
+                mmsg.msg_hdr.msg_iov->iov_base);
+        pinfo.payloadSize = mmsg.msg_len;
+        pinfo.capturedSize = std::min(mmsg.msg_len, captureSize_);
+
+        parseUdpCmsgs(&mmsg.msg_hdr, pinfo);
+
+        pinfo.dport = cfg_.dport();
         pinfo.source = net::IPv4Address::from_nl(sender.sin_addr.s_addr);
         pinfo.sport = ntohs(sender.sin_port);
-        return ReceivedPacket::Accepted;
+
+        pinfo.groupIndex = cfg_.groupIndex(pinfo.group);
+        return pinfo.groupIndex != Config::NoGroup;
     }
 };
 
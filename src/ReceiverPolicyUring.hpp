@@ -0,0 +1,280 @@
+#pragma once
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/io_uring.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include "PacketInfo.hpp"
+#include "AppUtils.hpp"
+#include "Config.hpp"
+#include "BpfFilter.hpp"
+#include "IoUring.hpp"
+#include "SocketUtils.hpp"
+#include "RxStats.hpp"
+
+namespace malt {
+
+/**
+ * Receives the UDP datagrams from a regular UDP socket through a single
+ * multishot recvmsg request of an io_uring instance. The kernel picks
+ * a buffer from the ring of the provided buffers for every datagram
+ * and writes the sender address, the control messages and the payload
+ * into it, thus a datagram costs no system call. The epoll instance
+ * waits on the io_uring descriptor, which becomes readable whenever
+ * a completion is posted.
+ *
+ * The payloads of the batch point into the provided buffers, which are
+ * given back to the kernel once the batch has been processed. If the
+ * kernel runs out of the buffers, the request is terminated and
+ * armed again on the next receive.
+ *
+ * Otherwise the socket is set up and the datagrams are filtered as
+ * they are by the regular policy.
+ */
+class ReceiverPolicyUring final {
+    static constexpr unsigned SqEntries{8};
+    static constexpr unsigned CqEntries{4096};
+    static constexpr uint16_t BufGroup{0};
+    // The number of the provided buffers must be a power of two
+    static constexpr unsigned PrefixBufCount{2048};
+    static constexpr unsigned FullBufCount{128};
+
+public:
+    ReceiverPolicyUring(Config const& cfg, unsigned worker)
+    : cfg_{cfg}
+    , worker_{worker}
+    , bufs_{bufCount(cfg.showPayload()),
+            bufSize(payloadCaptureSize(cfg.showPayload()))}
+    , batch_{std::min(cfg.batch(), bufCount(cfg.showPayload()) / 2)}
+    , bids_(batch_.capacity())
+    , msg_{}
+    , armed_{false}
+    , filterStats_{} {
+        msg_.msg_namelen = sizeof(sockaddr_in);
+        msg_.msg_controllen = sizeof(UdpCmsgBuf);
+    }
+
+    /**
+     * Checks whether the kernel supports the multishot recvmsg requests
+     * with the provided buffer rings, which are available since
+     * Linux 6.0. The io_uring may also be disabled by the host.
+     */
+    static bool supported() {
+        IoUring ring;
+        if (! ring.init(SqEntries, SqEntries))
+            return false;
+
+        ProvidedBuffers bufs{1, bufSize(0)};
+        if (! bufs.registerWith(ring, BufGroup))
+            return false;
+
+        int s = socket(AF_INET, SOCK_DGRAM, 0);
+        if (s == -1)
+            return false;
+
+        msghdr msg{};
+        bool submitted = ring.submit([s, &msg] (io_uring_sqe& sqe) {
+            prepareRecvMsg(sqe, s, msg);
+        });
+
+        // An unsupported request completes immediately with an error
+        bool rejected{false};
+        ring.reap(1, [&rejected] (io_uring_cqe const& cqe) {
+            rejected = cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP;
+        });
+        close(s);
+
+        return submitted && ! rejected;
+    }
+
+    int openSocket() {
+        int s = socket(AF_INET, SOCK_DGRAM, 0);
+
+        if (s == -1)
+            sysCallError("unable to create socket");
+
+        return s;
+    }
+
+    bool configureSocket(int s) {
+        if (! ring_.init(SqEntries, CqEntries))
+            return sysCallError("unable to set up io_uring instance");
+
+        if (! bufs_.registerWith(ring_, BufGroup))
+            return sysCallError("unable to register io_uring buffers");
+
+        if (! enableUdpRxInfo(s))
+            return false;
+
+        if (cfg_.threads() > 1
+            && ! attachFilter(s, makeShardFilter(worker_, cfg_.threads())))
+            return error("unable to shard the flows across the threads");
+
+        enableRxTimestamps(s);
+        return true;
+    }
+
+    bool bindSocket(int s) { return bindUdpPort(s, cfg_.dport()) && arm(s); }
+
+    int membershipSocket(int s) const { return s; }
+
+    int pollFd(int) const { return ring_.fd(); }
+
+    ReceivedPacket receivePackets(int s) {
+        batch_.resize(0);
+
+        if (! armed_ && ! arm(s))
+            return ReceivedPacket::Failed;
+
+        ring_.flushOverflow();
+
+        unsigned n{0};
+        unsigned filtered{0};
+        bool failed{false};
+        ring_.reap(batch_.capacity(), [&] (io_uring_cqe const& cqe) {
+            if ((cqe.flags & IORING_CQE_F_MORE) == 0)
+                armed_ = false;
+
+            if (cqe.res < 0) {
+                // The request is armed again once the buffers of
+                // the batch are given back
+                if (cqe.res != -ENOBUFS) {
+                    error("unable to receive packets: ", sysError(-cqe.res));
+                    failed = true;
+                }
+                return;
+            }
+
+            auto bid = static_cast<uint16_t>(
+                    cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            if (fillPacketInfo(bufs_.data(bid),
+                    static_cast<unsigned>(cqe.res), batch_[n])) {
+                bids_[n++] = bid;
+            } else {
+                filterStats_.add(batch_[n].payloadSize);
+                bufs_.add(bid);
+                ++filtered;
+            }
+        });
+
+        if (filtered > 0)
+            bufs_.commit();
+
+        if (failed)
+            return ReceivedPacket::Failed;
+
+        // Nothing would be received while waiting for the next wakeup
+        if (! armed_ && n == 0 && ! arm(s))
+            return ReceivedPacket::Failed;
+
+        batch_.resize(n);
+        if (n > 0)
+            return ReceivedPacket::Accepted;
+
+        return filtered > 0 ? ReceivedPacket::Filtered
+                            : ReceivedPacket::WouldBlock;
+    }
+
+    PacketBatch& batch() { return batch_; }
+
+    /**
+     * Gives the buffers of the last batch back to the kernel
+     */
+    void releaseBatch() {
+        for (unsigned i{0}; i < batch_.size(); ++i)
+            bufs_.add(bids_[i]);
+        bufs_.commit();
+        batch_.resize(0);
+    }
+
+    FilterStats const& filterStats() const { return filterStats_; }
+
+private:
+    Config const& cfg_;
+    unsigned worker_;
+    IoUring ring_;
+    ProvidedBuffers bufs_;
+    PacketBatch batch_;
+    // The ids of the buffers the packets of the batch point into
+    std::vector<uint16_t> bids_;
+    // The kernel reads the sizes of the sender address and the control
+    // messages to lay out the provided buffers from this header
+    msghdr msg_;
+    bool armed_;
+    FilterStats filterStats_;
+
+    static constexpr unsigned bufCount(bool fullPayload) {
+        return fullPayload ? FullBufCount : PrefixBufCount;
+    }
+
+    static constexpr unsigned bufSize(unsigned captureSize) {
+        return sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in)
+               + sizeof(UdpCmsgBuf) + captureSize;
+    }
+
+    static void prepareRecvMsg(io_uring_sqe& sqe, int s, msghdr& msg) {
+        sqe.opcode = IORING_OP_RECVMSG;
+        sqe.fd = s;
+        sqe.addr = reinterpret_cast<uint64_t>(&msg);
+        sqe.ioprio = IORING_RECV_MULTISHOT;
+        sqe.flags = IOSQE_BUFFER_SELECT;
+        sqe.buf_group = BufGroup;
+        sqe.msg_flags = MSG_TRUNC;
+    }
+
+    bool arm(int s) {
+        if (! ring_.submit([this, s] (io_uring_sqe& sqe) {
+                prepareRecvMsg(sqe, s, msg_);
+            }))
+            return sysCallError("unable to submit io_uring receive request");
+
+        armed_ = true;
+        return true;
+    }
+
+    /**
+     * The buffer starts with the io_uring_recvmsg_out header followed
+     * by the space for the sender address, the control messages and
+     * the payload sized as in msg_.
+     *
+     * @return false if the datagram is not destined for a configured
+     * group or not sent from a configured source port, true otherwise
+     */
+    bool fillPacketInfo(uint8_t* buf, unsigned len, PacketInfo& pinfo) {
+        auto out = reinterpret_cast<io_uring_recvmsg_out*>(buf);
+        uint8_t* name = buf + sizeof(*out);
+        uint8_t* control = name + msg_.msg_namelen;
+        uint8_t* payload = control + msg_.msg_controllen;
+
+        pinfo.payload = payload;
+        pinfo.payloadSize = out->payloadlen;
+        pinfo.capturedSize = len - static_cast<unsigned>(payload - buf);
+
+        msghdr cmsgs{};
+        cmsgs.msg_control = control;
+        cmsgs.msg_controllen = out->controllen;
+        parseUdpCmsgs(&cmsgs, pinfo);
+
+        sockaddr_in sender{};
+        memcpy(&sender, name,
+               std::min<std::size_t>(out->namelen, sizeof(sender)));
+
+        pinfo.dport = cfg_.dport();
+        pinfo.source = net::IPv4Address::from_nl(sender.sin_addr.s_addr);
+        pinfo.sport = ntohs(sender.sin_port);
+
+        if (! cfg_.sportAllowed(pinfo.sport))
+            return false;
+
+        pinfo.groupIndex = cfg_.groupIndex(pinfo.group);
+        return pinfo.groupIndex != Config::NoGroup;
+    }
+};
+
+} // namespace malt
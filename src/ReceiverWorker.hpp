@@ -0,0 +1,507 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Available since Linux 5.11
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
+#include "vdunlib/time/Time.hpp"
+#include "vdunlib/unix/SysError.hpp"
+
+#include "PacketInfo.hpp"
+#include "AppUtils.hpp"
+#include "AsyncOutput.hpp"
+#include "Config.hpp"
+#include "GroupTimeouts.hpp"
+#include "LineBudget.hpp"
+#include "OutputHandler.hpp"
+#include "Malt.hpp"
+#include "MaltBase.hpp"
+#include "PcapngWriter.hpp"
+#include "RxStats.hpp"
+
+namespace malt {
+
+/**
+ * Receives the traffic of one thread through its own socket, epoll
+ * instance and receiver policy and keeps its own stats. The timeout
+ * counters, the packet count and the output thread are shared by all
+ * the workers.
+ */
+template <typename ReceiverPolicy>
+class ReceiverWorker final: protected MaltBase {
+    static constexpr int BusyPollUsec{50};
+
+public:
+    ReceiverWorker(
+            Config const& cfg, OutputHandler& oh, StopFlag& stopped,
+            unsigned index, GroupTimeouts& timeouts,
+            std::atomic<uint64_t>& count, AsyncOutput& output)
+    : MaltBase{cfg, oh, stopped}
+    , index_{index}
+    , epfd_{-1}
+    , policy_{cfg, index}
+    , rxStats_{cfg.groups().size(), cfg.flowCapacity()}
+    , timeouts_{timeouts}
+    , count_{count}
+    , output_{output}
+    , lineBudget_{std::max(1u, cfg.lineRate() / cfg.threads()),
+                  TimeUtils::gethostnanos()}
+    , latencyIntervalNs_{cfg.latencyInterval() * 1'000'000'000ul}
+    , latencyStartNs_{TimeUtils::gethostnanos()}
+    , seqTracking_{cfg.seqTracking()}
+    , clockChecks_{(index == 0 && cfg.timeoutSec() > 0)
+                   || cfg.lineRate() > 0 || cfg.latencyInterval() > 0} {
+        if (! cfg.writeFile().empty())
+            writer_ = std::make_unique<PcapngWriter>(cfg, index);
+    }
+
+    ReceiverWorker(ReceiverWorker const&) = delete;
+    ReceiverWorker& operator= (ReceiverWorker const&) = delete;
+
+    ~ReceiverWorker() {
+        if (epfd_ != -1) {
+            int rc;
+            do {
+                rc = close(epfd_);
+            } while (rc == -1 && errno == EINTR);
+        }
+    }
+
+    bool init() {
+        s_ = policy_.openSocket();
+        if (s_ == -1)
+            return false;
+
+        if (! configureSocket())
+            return false;
+
+        if (writer_ && ! writer_->open())
+            return false;
+
+        if (cfg_.busyPoll())
+            return true;
+
+        return activatePoller();
+    }
+
+    int membershipSocket() const { return policy_.membershipSocket(s_); }
+
+    /**
+     * Receives until the workers are stopped. If the worker fails,
+     * it stops the other workers as well.
+     */
+    bool run() {
+        pinToCpu(index_, "receiver");
+
+        bool r;
+        {
+            RxStats::Timer rxStatsTimer{rxStats_};
+            r = cfg_.busyPoll() ? busyPoll() : waitAndReceive();
+        }
+        rxStats_.filterStats(policy_.filterStats());
+
+        if (! r)
+            stopped_ = true;
+
+        return r;
+    }
+
+    RxStats const& rxStats() const { return rxStats_; }
+
+private:
+    unsigned index_;
+    int epfd_;
+    ReceiverPolicy policy_;
+    RxStats rxStats_;
+    GroupTimeouts& timeouts_;
+    std::atomic<uint64_t>& count_;
+    AsyncOutput& output_;
+    // The packet lines shown by the worker are limited to its share
+    // of Config::lineRate() per display interval
+    LineBudget lineBudget_;
+    // 0 if the latencies are only reported at exit
+    uint64_t const latencyIntervalNs_;
+    uint64_t latencyStartNs_;
+    bool const seqTracking_;
+    // False if neither the timeouts nor any of the intervals are checked
+    bool const clockChecks_;
+    // Only set if the packets are written into a capture file
+    std::unique_ptr<PcapngWriter> writer_;
+
+    bool configureSocket() {
+        // Make socket non-blocking
+        int flags = fcntl(s_, F_GETFL);
+        if (flags == -1)
+            return sysCallError("fcntl() failed to get socket flags");
+
+        flags |= O_NONBLOCK;
+        int rv = fcntl(s_, F_SETFL, flags);
+        if (rv == -1)
+            return sysCallError("fcntl() failed to make socket non-blocking");
+
+        // allow multiple sockets use the same UDP ports
+        uint allowReuse = 1;
+        if (setsockopt(s_, SOL_SOCKET, SO_REUSEADDR,
+                       &allowReuse, sizeof(allowReuse)) == -1)
+            return sysCallError("cannot enable UDP port reuse");
+
+        // The workers bind their sockets to the same UDP port
+        if (cfg_.threads() > 1 && ! cfg_.wildcard()
+            && setsockopt(s_, SOL_SOCKET, SO_REUSEPORT,
+                          &allowReuse, sizeof(allowReuse)) == -1)
+            return sysCallError("cannot enable UDP port sharing");
+
+        int bufSize{BufferSize};
+        if (setsockopt(s_, SOL_SOCKET,
+                SO_RCVBUF, &bufSize, sizeof(bufSize)) == -1) {
+            warning("failed to set receive buffer size to ",
+                    bufSize, " bytes: ", sysError(errno));
+        }
+
+        if (cfg_.busyPoll())
+            enableBusyPoll();
+
+        if (! policy_.configureSocket(s_))
+            return false;
+
+        return policy_.bindSocket(s_);
+    }
+
+    /**
+     * Asks the kernel to busy poll the device queue when the socket
+     * has no data. Both options are only hints, malt spins on the
+     * socket even if the host doesn't allow them.
+     */
+    void enableBusyPoll() {
+        int busyPollUsec{BusyPollUsec};
+        if (setsockopt(s_, SOL_SOCKET,
+                SO_BUSY_POLL, &busyPollUsec, sizeof(busyPollUsec)) == -1)
+            warning("failed to enable busy polling of the device queue: ",
+                    sysError(errno));
+
+        int preferBusyPoll{1};
+        if (setsockopt(s_, SOL_SOCKET, SO_PREFER_BUSY_POLL,
+                &preferBusyPoll, sizeof(preferBusyPoll)) == -1)
+            warning("failed to prefer busy polling of the device queue: ",
+                    sysError(errno));
+    }
+
+    /**
+     * Registers the descriptor the policy signals the received packets
+     * on, which is the socket unless the policy receives through
+     * a completion queue
+     */
+    bool activatePoller() {
+        epfd_ = epoll_create1(0);
+        if (epfd_ == -1)
+            return sysCallError("unable to create epoll instance");
+
+        int fd = policy_.pollFd(s_);
+        epoll_event ev{};
+        ev.data.fd = fd;
+        ev.events = EPOLLIN | EPOLLPRI;
+        if (cfg_.edgeTriggered())
+            ev.events |= EPOLLET;
+
+        if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) == -1)
+            return sysCallError("unable to add socket to epoll instance");
+
+        return true;
+    }
+
+    /**
+     * Shows and accounts the packets of the last received batch and
+     * resets the timeout counters of their groups to their times.
+     * If the packet count limit shared by the workers is reached in
+     * the middle of the batch the remaining packets are ignored and
+     * all the workers are stopped.
+     *
+     * @return true if the packet count limit is reached
+     */
+    bool processBatch() {
+        PacketBatch& batch = policy_.batch();
+        unsigned n = batch.size();
+        bool countReached{false};
+        if (cfg_.count() > 0) {
+            uint64_t count = count_.fetch_add(n, std::memory_order_relaxed);
+            if (count >= cfg_.count())
+                n = 0;
+            else if (cfg_.count() - count < n)
+                n = static_cast<unsigned>(cfg_.count() - count);
+
+            countReached = count + n >= cfg_.count();
+            if (countReached)
+                stopped_ = true;
+        }
+
+        // The host time is only needed if the kernel didn't
+        // timestamp the packets
+        uint64_t hostTs{0};
+        for (unsigned i{0}; i < n; ++i) {
+            PacketInfo& pinfo = batch[i];
+            if (pinfo.timestamp == 0) {
+                if (hostTs == 0)
+                    hostTs = TimeUtils::gethostnanos();
+                pinfo.timestamp = hostTs;
+            }
+            if (cfg_.lineRate() == 0 || lineBudget_.takeLine())
+                output_.showRcvdPacket(index_, pinfo);
+            // The capture is given up, but the reception goes on
+            if (writer_ && ! writer_->write(pinfo))
+                writer_.reset();
+            SeqGap gap = rxStats_.update(
+                    pinfo, latencyIntervalNs_ > 0, seqTracking_);
+            if (gap.count > 0)
+                output_.showSeqGap(index_, gap);
+            timeouts_.reset(pinfo.groupIndex, pinfo.timestamp);
+        }
+
+        // A busy group would otherwise prevent the timeouts of the
+        // silent groups from being reported
+        checkIntervals();
+        return countReached;
+    }
+
+    /**
+     * Reports the timeouts and ends the display and the latency
+     * intervals which have passed. The host clock is read once for all
+     * of them and not at all if none of them is enabled.
+     */
+    void checkIntervals() {
+        if (! clockChecks_) return;
+
+        uint64_t hostNs = TimeUtils::gethostnanos();
+        checkTimeouts(hostNs);
+        checkDisplayInterval(hostNs);
+        checkLatencyInterval(hostNs);
+    }
+
+    /**
+     * Ends the display interval once it has passed
+     */
+    void checkDisplayInterval(uint64_t hostNs) {
+        if (cfg_.lineRate() == 0) return;
+
+        lineBudget_.check(hostNs, cfg_.groups(), rxStats_,
+                [this] (FlowSummary const& summary) {
+            output_.showFlowSummary(index_, summary);
+        });
+    }
+
+    /**
+     * Ends the latency interval once it has passed, the latencies of
+     * every flow which received any beacon in the interval are shown
+     * and forgotten
+     */
+    void checkLatencyInterval(uint64_t hostNs) {
+        if (latencyIntervalNs_ == 0) return;
+
+        if (hostNs < latencyStartNs_ + latencyIntervalNs_) return;
+
+        auto const& groups = cfg_.groups();
+        for (unsigned g{0}; g < groups.size(); ++g) {
+            rxStats_.group(g).forEachLatency(
+                    [&] (auto source, auto sport, auto dport,
+                         FlowStats& fs) {
+                LatencyHistogram& lh = fs.intervalLatency();
+                LatencySummary summary{};
+                summary.timestamp = hostNs;
+                summary.source = source;
+                summary.sport = sport;
+                summary.group = groups[g];
+                summary.dport = dport;
+                summary.count = lh.count();
+                summary.minNs = lh.min();
+                summary.p50Ns = lh.percentile(50);
+                summary.p90Ns = lh.percentile(90);
+                summary.p99Ns = lh.percentile(99);
+                summary.p999Ns = lh.percentile(99.9);
+                summary.maxNs = lh.max();
+                output_.showLatencySummary(index_, summary);
+                lh.reset();
+            });
+        }
+
+        latencyStartNs_ = hostNs;
+    }
+
+    /**
+     * Only the first worker reports the timeouts, the groups are
+     * shared by all of them
+     */
+    void checkTimeouts(uint64_t hostNs) {
+        if (index_ != 0) return;
+
+        timeouts_.check(hostNs, [this] (unsigned group, uint64_t ts) {
+            output_.showTimeout(index_, ts, cfg_.groups()[group]);
+        });
+    }
+
+    /**
+     * Waits on the epoll instance and drains the socket every time it
+     * becomes readable. If the receive budget is exhausted before the
+     * socket is drained, the rest is received in the next iteration
+     * without waiting, which is required in the edge triggered mode.
+     */
+    bool waitAndReceive() {
+        epoll_event rcvEv{};
+        bool pending{false};
+
+        while (! stopped_) {
+            int rc = 1;
+            if (! pending)
+                rc = epoll_wait(epfd_, &rcvEv, 1, 100);
+
+            if (rc == -1) {
+                if (errno == EINTR)
+                    continue;
+
+                return sysCallError(
+                        "failure while waiting on epoll instance");
+            }
+
+            if (rc == 0) {
+                checkIntervals();
+                continue;
+            }
+
+            if (rcvEv.events & EPOLLHUP)
+                return error("received epoll hangup");
+
+            if (rcvEv.events & EPOLLERR) {
+                int soError{0};
+                socklen_t soErrorLen{sizeof(soError)};
+
+                rc = getsockopt(s_,
+                        SOL_SOCKET, SO_ERROR, &soError, &soErrorLen);
+
+                if (rc == -1)
+                    return sysCallError(
+                            "epoll_wait indicated socket error, "
+                            "but getsockopt() unabled to get the error code");
+
+                return error("socket error: ", sysError(soError));
+            }
+
+            if ((rcvEv.events & EPOLLIN) || (rcvEv.events & EPOLLPRI)) {
+                switch (drain()) {
+                case Drained::Done:
+                    pending = false;
+                    break;
+
+                case Drained::BudgetExhausted:
+                    pending = true;
+                    break;
+
+                case Drained::CountReached:
+                    return true;
+
+                case Drained::Failed:
+                    return false;
+                }
+            }
+        }
+
+        // we were stopped
+        return true;
+    }
+
+    enum class Drained {
+        Done,
+        BudgetExhausted,
+        CountReached,
+        Failed
+    };
+
+    /**
+     * Receives the packets until the socket would block or the budget
+     * is exhausted. Both the accepted and the filtered packets are
+     * charged to the budget, but only the accepted ones are recorded
+     * in the wakeup stats.
+     */
+    Drained drain() {
+        uint64_t delivered{0};
+        uint64_t charged{0};
+        Drained result{Drained::BudgetExhausted};
+
+        while (! stopped_
+               && (cfg_.budget() == 0 || charged < cfg_.budget())) {
+            auto rp = policy_.receivePackets(s_);
+
+            if (rp == ReceivedPacket::Accepted) {
+                unsigned n = policy_.batch().size();
+                delivered += n;
+                charged += n;
+                if (processBatch()) {
+                    result = Drained::CountReached;
+                    break;
+                }
+                policy_.releaseBatch();
+            } else if (rp == ReceivedPacket::Filtered) {
+                ++charged;
+                // A steady stream of the filtered packets would
+                // otherwise prevent the timeouts from being reported
+                checkIntervals();
+            } else if (rp == ReceivedPacket::WouldBlock) {
+                result = Drained::Done;
+                break;
+            } else {
+                result = Drained::Failed;
+                break;
+            }
+        }
+
+        rxStats_.wakeupStats().add(delivered);
+        return result;
+    }
+
+    /**
+     * Spins on the non-blocking socket instead of waiting on the epoll
+     * instance. The host time is taken on every spin which doesn't
+     * receive a packet of interest, thus the timeouts and the stop
+     * requests are handled as they would be in the epoll mode, just
+     * without the 100 ms wait.
+     */
+    bool busyPoll() {
+        BusyPollStats& bps = rxStats_.busyPollStats();
+
+        while (! stopped_) {
+            switch (policy_.receivePackets(s_)) {
+            case ReceivedPacket::Accepted:
+                ++bps.productiveSpins;
+                if (processBatch())
+                    return true;
+                policy_.releaseBatch();
+                continue;
+
+            case ReceivedPacket::Filtered:
+                ++bps.productiveSpins;
+                break;
+
+            case ReceivedPacket::WouldBlock:
+                ++bps.emptySpins;
+                break;
+
+            case ReceivedPacket::Failed:
+                return false;
+            }
+
+            checkIntervals();
+        }
+
+        // we were stopped
+        return true;
+    }
+};
+
+} // namespace malt
@@ -1,13 +1,20 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
-#include <unordered_map>
-#include <set>
+#include <utility>
+#include <vector>
 
 #include "vdunlib/core/CompilerUtils.hpp"
 #include "vdunlib/net/IPv4Address.hpp"
 #include "vdunlib/time/Time.hpp"
 
+#include "PacketInfo.hpp"
+#include "FlowTable.hpp"
+#include "LatencyHistogram.hpp"
+#include "MaltBeaconHdr.hpp"
+#include "SeqTracker.hpp"
+
 namespace malt {
 
 VDUNLIB_ALWAYS_INLINE
@@ -34,7 +41,86 @@ static constexpr uint16_t flowDPort(uint64_t flowId) {
     return static_cast<uint16_t>((flowId >> 48u) & 0xFFFFu);
 }
 
+/**
+ * The interarrival jitter of a flow as defined by RFC 3550 and the
+ * distribution of its inter-packet gaps. The jitter is estimated from
+ * the transit times of the beacons, the flows carrying no beacons
+ * estimate it from the variation of their inter-packet gaps instead,
+ * which assumes a constant sending rate. The updates take no branches
+ * besides the conditional moves.
+ */
+class ArrivalStats final {
+public:
+    // The first bucket holds the gaps below 1 usec, each of the
+    // following ones doubles the range, the last one is open
+    static constexpr unsigned Buckets{24};
+
+    explicit ArrivalStats(uint64_t ts)
+    : lastTs_{ts}, lastGap_{0}, gapJitter_{0}
+    , transits_{0}, lastTransit_{0}, transitJitter_{0}, hist_{} {}
+
+    void add(uint64_t ts, bool firstGap) {
+        uint64_t gap = ts > lastTs_ ? ts - lastTs_ : 0;
+        lastTs_ = std::max(lastTs_, ts);
+        auto d = static_cast<int64_t>(gap - lastGap_);
+        lastGap_ = gap;
+        updateJitter(gapJitter_, firstGap ? 0 : d);
+
+        uint64_t usec = gap / 1'000;
+        auto b = static_cast<unsigned>(63 - __builtin_clzl((usec << 1u) | 1));
+        ++hist_[std::min(b, Buckets - 1)];
+    }
+
+    /**
+     * Adds the transit time of a beacon, the difference between its
+     * receive time and its send time
+     */
+    void addTransit(int64_t transit) {
+        int64_t d = transit - lastTransit_;
+        lastTransit_ = transit;
+        updateJitter(transitJitter_, transits_ == 0 ? 0 : d);
+        ++transits_;
+    }
+
+    /**
+     * The jitter of the workers receiving the same flow can't be merged,
+     * the highest one is kept
+     */
+    void merge(ArrivalStats const& as) {
+        gapJitter_ = std::max(gapJitter_, as.gapJitter_);
+        transitJitter_ = std::max(transitJitter_, as.transitJitter_);
+        transits_ += as.transits_;
+        for (unsigned b{0}; b < Buckets; ++b)
+            hist_[b] += as.hist_[b];
+    }
+
+    /**
+     * @return the jitter in nanoseconds
+     */
+    uint64_t jitterNs() const {
+        return (transits_ > 1 ? transitJitter_ : gapJitter_) >> 4u;
+    }
+
+    uint64_t bucket(unsigned b) const { return hist_[b]; }
+
+private:
+    uint64_t lastTs_;
+    uint64_t lastGap_;
+    // Both jitters are scaled by 16 as in the RFC 3550 appendix A.8
+    uint64_t gapJitter_;
+    uint64_t transits_;
+    int64_t lastTransit_;
+    uint64_t transitJitter_;
+    uint64_t hist_[Buckets];
+
+    static void updateJitter(uint64_t& jitter, int64_t d) {
+        auto absD = static_cast<uint64_t>(d < 0 ? -d : d);
+        jitter += absD - ((jitter + 8) >> 4u);
+    }
+};
+
 class FlowStats final {
+public:
     constexpr static uint64_t withHeaders(uint64_t udpBytes) {
         // 12 bytes MAC header (we assume no VLAN)
         // 20 bytes IP header
@@ -43,24 +129,321 @@ class FlowStats final {
         // 4 bytes FSC
         return 12u + 20u + 8u + udpBytes + 4u;
     }
-public:
-    constexpr explicit FlowStats(uint64_t udpBytes)
-    : pkts_{1}, bytes_{withHeaders(udpBytes)} {}
 
-    void add(uint64_t udpBytes) {
+    FlowStats(uint64_t udpBytes, int16_t ttl, uint64_t ts)
+    : pkts_{1}, bytes_{withHeaders(udpBytes)}
+    , markPkts_{0}, markBytes_{0}, ttl_{ttl}, arrival_{ts} {}
+
+    void add(uint64_t udpBytes, int16_t ttl, uint64_t ts) {
         ++pkts_;
         bytes_ += withHeaders(udpBytes);
+        ttl_ = ttl;
+        arrival_.add(ts, pkts_ == 2);
     }
 
+    void merge(FlowStats const& fs) {
+        pkts_ += fs.pkts_;
+        bytes_ += fs.bytes_;
+        arrival_.merge(fs.arrival_);
+        latency_.merge(fs.latency_);
+        seq_.merge(fs.seq_);
+    }
+
+    /**
+     * Records the one-way latency of a beacon, the latencies of the
+     * periodic dump are only recorded if it is enabled
+     */
+    void addLatency(int64_t ns, bool interval) {
+        arrival_.addTransit(ns);
+        latency_.record(ns);
+        if (interval)
+            intervalLatency_.record(ns);
+    }
+
+    /**
+     * @return the number of the beacons missing before the sequence
+     * number if it skips any, 0 otherwise
+     */
+    uint64_t addSeq(uint64_t seq) { return seq_.add(seq); }
+
     uint64_t pkts() const { return pkts_; }
     uint64_t bytes() const { return bytes_; }
     unsigned avgPktSize() const { return bytes_ / pkts_; }
 
+    /**
+     * @return the TTL of the last packet, -1 if unknown
+     */
+    int16_t ttl() const { return ttl_; }
+
+    /**
+     * The packets and bytes received since the last mark
+     */
+    uint64_t intervalPkts() const { return pkts_ - markPkts_; }
+    uint64_t intervalBytes() const { return bytes_ - markBytes_; }
+
+    void mark() {
+        markPkts_ = pkts_;
+        markBytes_ = bytes_;
+    }
+
+    LatencyHistogram const& latency() const { return latency_; }
+    SeqTracker const& seq() const { return seq_; }
+    ArrivalStats const& arrival() const { return arrival_; }
+
+    /**
+     * The latencies recorded since the last periodic dump
+     */
+    LatencyHistogram& intervalLatency() { return intervalLatency_; }
+
 private:
     uint64_t pkts_;
     uint64_t bytes_;
+    uint64_t markPkts_;
+    uint64_t markBytes_;
+    int16_t ttl_;
+    ArrivalStats arrival_;
+    LatencyHistogram latency_;
+    LatencyHistogram intervalLatency_;
+    SeqTracker seq_;
+};
+
+/**
+ * The traffic of a flow received in a display interval ending at
+ * the timestamp
+ */
+struct FlowSummary final {
+    uint64_t timestamp;
+    uint64_t durationNanos;
+    net::IPv4Address source;
+    uint16_t sport;
+    net::IPv4Address group;
+    uint16_t dport;
+    int16_t ttl;
+    uint64_t pkts;
+    // Including the headers as in FlowStats
+    uint64_t bytes;
+};
+
+/**
+ * The one-way latencies of the beacons of a flow received in a latency
+ * dump interval ending at the timestamp
+ */
+struct LatencySummary final {
+    uint64_t timestamp;
+    net::IPv4Address source;
+    uint16_t sport;
+    net::IPv4Address group;
+    uint16_t dport;
+    uint64_t count;
+    int64_t minNs;
+    int64_t p50Ns;
+    int64_t p90Ns;
+    int64_t p99Ns;
+    int64_t p999Ns;
+    int64_t maxNs;
+};
+
+/**
+ * The beacons of a flow skipped by the beacon received at the timestamp
+ */
+struct SeqGap final {
+    uint64_t timestamp;
+    net::IPv4Address source;
+    uint16_t sport;
+    net::IPv4Address group;
+    uint16_t dport;
+    // The first missing sequence number
+    uint64_t firstSeq;
+    uint64_t count;
+};
+
+/**
+ * The packets received by malt, but discarded because they didn't
+ * match the configured group, source or source ports
+ */
+struct FilterStats final {
+    uint64_t pkts;
+    uint64_t bytes;
+    // true if the non-matching packets are also filtered in the kernel
+    bool kernelFilter;
+
+    void add(uint64_t rcvdBytes) {
+        ++pkts;
+        bytes += rcvdBytes;
+    }
+
+    void merge(FilterStats const& fs) {
+        pkts += fs.pkts;
+        bytes += fs.bytes;
+    }
 };
 
+/**
+ * The receive attempts made in the busy poll mode. A spin is productive
+ * if it received any packet, even if the packet was filtered.
+ */
+struct BusyPollStats final {
+    uint64_t productiveSpins;
+    uint64_t emptySpins;
+
+    void merge(BusyPollStats const& bps) {
+        productiveSpins += bps.productiveSpins;
+        emptySpins += bps.emptySpins;
+    }
+};
+
+/**
+ * The distribution of the number of packets received per epoll wakeup.
+ * The bucket i counts the wakeups which delivered a number of packets
+ * in range [2^(i-1), 2^i), the bucket 0 counts the wakeups which
+ * delivered no packet.
+ */
+class WakeupStats final {
+public:
+    static constexpr unsigned Buckets{12};
+
+    void add(uint64_t pkts) {
+        ++wakeups_;
+        pkts_ += pkts;
+        unsigned b{0};
+        while (pkts > 0 && b < Buckets - 1) {
+            pkts >>= 1u;
+            ++b;
+        }
+        ++hist_[b];
+    }
+
+    void merge(WakeupStats const& ws) {
+        wakeups_ += ws.wakeups_;
+        pkts_ += ws.pkts_;
+        for (unsigned b{0}; b < Buckets; ++b)
+            hist_[b] += ws.hist_[b];
+    }
+
+    uint64_t wakeups() const { return wakeups_; }
+    uint64_t pkts() const { return pkts_; }
+    uint64_t bucket(unsigned b) const { return hist_[b]; }
+
+private:
+    uint64_t wakeups_{0};
+    uint64_t pkts_{0};
+    uint64_t hist_[Buckets]{};
+};
+
+/**
+ * The stats of the flows of a single group. A group which hasn't
+ * received any packet allocates no memory besides this object. The
+ * flows are kept in the order they were first received and sorted only
+ * when they are reported.
+ */
+class GroupRxStats final {
+public:
+    /**
+     * @param flowCapacity the number of the flows the group makes room
+     * for with its first packet
+     */
+    explicit GroupRxStats(std::size_t flowCapacity)
+    : flows_{flowCapacity} {}
+
+    /**
+     * @return the stats of the flow of the packet
+     */
+    FlowStats& update(net::IPv4Address source, uint16_t sport,
+            uint16_t dport, uint64_t udpBytes, int16_t ttl, uint64_t ts) {
+        auto fid = flowId(source, sport, dport);
+
+        auto fe = flows_.tryEmplace(fid, udpBytes, ttl, ts);
+        if (! fe.second)
+            fe.first->add(udpBytes, ttl, ts);
+
+        return *fe.first;
+    }
+
+    template <typename Consumer>
+    void sortedForEach(Consumer&& consume) const {
+        for (auto i: sortedFlows()) {
+            uint64_t fid = flows_.key(i);
+            consume(flowSource(fid),
+                    flowSPort(fid), flowDPort(fid), flows_.value(i));
+        }
+    }
+
+    /**
+     * Passes the flows which received any packet since the last call
+     * to the consumer and marks the start of the next interval
+     */
+    template <typename Consumer>
+    void forEachInInterval(Consumer&& consume) {
+        for (std::size_t i{0}; i < flows_.size(); ++i) {
+            FlowStats& fs = flows_.value(i);
+            if (fs.intervalPkts() == 0)
+                continue;
+
+            uint64_t fid = flows_.key(i);
+            consume(flowSource(fid), flowSPort(fid), flowDPort(fid), fs);
+            fs.mark();
+        }
+    }
+
+    /**
+     * Passes the flows which received any beacon since the last call to
+     * the consumer, which is expected to reset their interval latencies
+     */
+    template <typename Consumer>
+    void forEachLatency(Consumer&& consume) {
+        for (std::size_t i{0}; i < flows_.size(); ++i) {
+            FlowStats& fs = flows_.value(i);
+            if (fs.intervalLatency().count() == 0)
+                continue;
+
+            uint64_t fid = flows_.key(i);
+            consume(flowSource(fid), flowSPort(fid), flowDPort(fid), fs);
+        }
+    }
+
+    void merge(GroupRxStats const& grs) {
+        for (std::size_t i{0}; i < grs.flows_.size(); ++i) {
+            FlowStats const& fs = grs.flows_.value(i);
+            auto fe = flows_.tryEmplace(grs.flows_.key(i), fs);
+            if (! fe.second)
+                fe.first->merge(fs);
+        }
+    }
+
+    uint64_t pkts() const {
+        uint64_t pkts{0};
+        for (std::size_t i{0}; i < flows_.size(); ++i)
+            pkts += flows_.value(i).pkts();
+        return pkts;
+    }
+
+    std::size_t size() const { return flows_.size(); }
+
+private:
+    FlowTable<FlowStats> flows_;
+    // The indexes of the flows sorted by their ids, rebuilt once new
+    // flows were received
+    mutable std::vector<uint32_t> sorted_;
+
+    std::vector<uint32_t> const& sortedFlows() const {
+        if (sorted_.size() == flows_.size())
+            return sorted_;
+
+        sorted_.resize(flows_.size());
+        for (std::size_t i{0}; i < sorted_.size(); ++i)
+            sorted_[i] = static_cast<uint32_t>(i);
+        std::sort(sorted_.begin(), sorted_.end(),
+                [this] (uint32_t a, uint32_t b) {
+            return flows_.key(a) < flows_.key(b);
+        });
+        return sorted_;
+    }
+};
+
+/**
+ * The stats of the received traffic. Every receiver worker keeps its
+ * own stats, which are merged only when they are reported.
+ */
 class RxStats final {
 public:
     class Timer final {
@@ -84,33 +467,124 @@ public:
 
     friend class RxStats::Timer;
 
-    void update(net::IPv4Address source,
-            uint16_t sport, uint16_t dport, uint64_t udpBytes) {
-        auto fid = flowId(source, sport, dport);
+    /**
+     * @param groups the number of the configured groups
+     * @param flowCapacity the initial number of the flows of a group
+     */
+    RxStats(std::size_t groups, std::size_t flowCapacity)
+    : groupStats_(groups, GroupRxStats{flowCapacity}), durationNanos_{0} {}
+
+    /**
+     * @param group the index of the group in Config::groups()
+     */
+    GroupRxStats& group(unsigned group) { return groupStats_[group]; }
 
-        auto fme = fsMap_.emplace(fid, udpBytes);
-        if (! fme.second)
-            fme.first->second.add(udpBytes);
-        else fids_.emplace(fid);
+    GroupRxStats const& group(unsigned group) const {
+        return groupStats_[group];
     }
 
-    template <typename Consumer>
-    void sortedForEach(Consumer&& consume) const {
-        for (const auto& fid: fids_) {
-            consume(flowSource(fid),
-                    flowSPort(fid), flowDPort(fid),
-                    fsMap_.find(fid)->second);
+    /**
+     * Accounts the packet to its flow and if it is a malt beacon, also
+     * its latency and its sequence number
+     *
+     * @param intervalLatency true if the latency is also recorded for
+     * the periodic dump
+     * @param seqTracking false if the sequence number is ignored
+     * @return the beacons the packet skipped, their count is 0 if none
+     */
+    SeqGap update(
+            PacketInfo const& pinfo, bool intervalLatency, bool seqTracking) {
+        FlowStats& fs = groupStats_[pinfo.groupIndex].update(
+                pinfo.source, pinfo.sport,
+                pinfo.dport, pinfo.payloadSize, pinfo.ttl, pinfo.timestamp);
+
+        SeqGap gap{};
+        auto hdr = parseBeacon(
+                pinfo.payload, pinfo.payloadSize, pinfo.capturedSize);
+        if (hdr == nullptr)
+            return gap;
+
+        fs.addLatency(static_cast<int64_t>(pinfo.timestamp - hdr->timeNs),
+                      intervalLatency);
+        if (! seqTracking)
+            return gap;
+
+        uint64_t missing = fs.addSeq(hdr->seq);
+        if (missing > 0) {
+            gap.timestamp = pinfo.timestamp;
+            gap.source = pinfo.source;
+            gap.sport = pinfo.sport;
+            gap.group = pinfo.group;
+            gap.dport = pinfo.dport;
+            gap.firstSeq = hdr->seq - missing;
+            gap.count = missing;
         }
+        return gap;
     }
 
+    /**
+     * Adds the stats of a worker. The duration is the longest duration
+     * of the workers and the packets accepted by each of the workers
+     * are recorded in the order they are merged.
+     */
+    void merge(RxStats const& rxs) {
+        uint64_t pkts{0};
+        for (std::size_t g{0}; g < groupStats_.size(); ++g) {
+            groupStats_[g].merge(rxs.groupStats_[g]);
+            pkts += rxs.groupStats_[g].pkts();
+        }
+        workerPkts_.push_back(pkts);
+
+        durationNanos_ = std::max(durationNanos_, rxs.durationNanos_);
+        filterStats_.kernelFilter = workerPkts_.size() == 1
+                ? rxs.filterStats_.kernelFilter
+                : filterStats_.kernelFilter && rxs.filterStats_.kernelFilter;
+        filterStats_.merge(rxs.filterStats_);
+        busyPollStats_.merge(rxs.busyPollStats_);
+        wakeupStats_.merge(rxs.wakeupStats_);
+    }
+
+    /**
+     * @return the number of the packets accepted by each of the merged
+     * workers
+     */
+    std::vector<uint64_t> const& workerPkts() const { return workerPkts_; }
+
     uint64_t durationNanos() const { return durationNanos_; }
 
-    std::size_t size() const { return fsMap_.size(); }
+    /**
+     * Sets the duration if the stats are not timed by the host clock
+     */
+    void durationNanos(uint64_t duration) { durationNanos_ = duration; }
+
+    FilterStats const& filterStats() const { return filterStats_; }
+
+    void filterStats(FilterStats const& fs) { filterStats_ = fs; }
+
+    BusyPollStats& busyPollStats() { return busyPollStats_; }
+
+    BusyPollStats const& busyPollStats() const { return busyPollStats_; }
+
+    WakeupStats& wakeupStats() { return wakeupStats_; }
+
+    WakeupStats const& wakeupStats() const { return wakeupStats_; }
+
+    /**
+     * @return the number of the packet and timeout lines which were
+     * not shown because the output couldn't keep up
+     */
+    uint64_t droppedLines() const { return droppedLines_; }
+
+    void droppedLines(uint64_t dropped) { droppedLines_ = dropped; }
 
 private:
-    std::unordered_map<uint64_t, FlowStats> fsMap_;
-    std::set<uint64_t> fids_;
+    std::vector<GroupRxStats> groupStats_;
     uint64_t durationNanos_;
+    FilterStats filterStats_{};
+    BusyPollStats busyPollStats_{};
+    WakeupStats wakeupStats_{};
+    std::vector<uint64_t> workerPkts_;
+    uint64_t droppedLines_{0};
 };
 
 }
\ No newline at end of file
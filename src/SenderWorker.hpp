@@ -0,0 +1,585 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/net_tstamp.h>
+#include <linux/udp.h>
+#include <poll.h>
+#include <time.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "vdunlib/time/Time.hpp"
+
+#include "MaltBeaconHdr.hpp"
+#include "AppUtils.hpp"
+#include "Config.hpp"
+#include "OutputHandler.hpp"
+#include "Malt.hpp"
+#include "MaltBase.hpp"
+#include "RxStats.hpp"
+#include "SizeMix.hpp"
+#include "SocketUtils.hpp"
+#include "TimerWheel.hpp"
+#include "TxStats.hpp"
+
+namespace malt {
+
+/**
+ * Makes the socket send the multicast through the configured interface
+ * with the configured TTL and loop it back to this host
+ */
+inline bool configureSenderSocket(Config const& cfg, int s) {
+    auto ttl = static_cast<u_char>(cfg.ttl());
+    if (setsockopt(s, IPPROTO_IP,
+                   IP_MULTICAST_TTL, &ttl, sizeof(ttl)) == -1)
+        return error("unable to set TTL ", ttl, ": ", sysError(errno));
+
+    // this is required to allow this host to receive its own packets
+    u_char loopback{1};
+    if (setsockopt(s, IPPROTO_IP,
+                   IP_MULTICAST_LOOP, &loopback, sizeof(loopback)) == -1)
+        return error("unable to set loopback mode on socket");
+
+    in_addr intfAddr { .s_addr = cfg.intfAddr().to_nl() };
+    if (setsockopt(s, IPPROTO_IP,
+        IP_MULTICAST_IF, &intfAddr, sizeof(intfAddr)) == -1)
+        return error("unable to make ", cfg.intf(),
+                     " (addr ", cfg.intfAddr(),
+                     ") output multicast interface",
+                     sysError(errno));
+
+    return true;
+}
+
+/**
+ * Sends its share of the paced flows from its own socket. Every flow
+ * keeps its own schedule and sequence numbers and waits for its next
+ * packet in a timer wheel, thus the cost of a packet doesn't depend on
+ * the number of the flows. The packets due at the same time are sent
+ * with a single sendmmsg(), whichever flows they belong to.
+ *
+ * The packet k of a flow is due k packet intervals after the start of
+ * the flow, which is derived from the rate without accumulating any
+ * rounding error. The beacons are padded to the sizes of the mix, the
+ * bit rate of a flow is then kept on average over the period of the
+ * mix. The starts of the flows are spread over their first interval to
+ * avoid sending the packets of all the flows at once.
+ * A flow which falls more than a millisecond behind its schedule skips
+ * the packets instead of bursting to catch up, they are counted as the
+ * missed deadlines. The beacons carry the time they were due at, not
+ * the time of the pass which sent them.
+ *
+ * With Config::gso() the consecutive packets of a flow in the batch are
+ * sent as a single datagram the kernel segments into the packets with
+ * UDP GSO, thus the stack is traversed once per up to 64 packets. If the
+ * kernel refuses the segmentation, the worker warns and falls back to
+ * sending the packets one by one.
+ *
+ * In the kernel pacing modes the packets are sent up to LeadNs before
+ * they are due and the worker sleeps between the passes instead of
+ * spinning. The kernel holds every packet until the launch time attached
+ * to it with SO_TXTIME or spaces the packets of the socket by the rate
+ * of its flows with SO_MAX_PACING_RATE. If the kernel doesn't support
+ * the mode, the worker warns and paces the packets on its own.
+ *
+ * With Config::txTimestamps() the kernel reports the time every datagram
+ * is passed to the device on the error queue of the socket, the reports
+ * are matched to the schedule of the datagrams by their send index.
+ */
+class SenderWorker final: protected MaltBase {
+    // The worker sleeps until this much before the next packet is due
+    // and spins for the rest to keep the microsecond accuracy
+    static constexpr uint64_t SpinNanos{50'000};
+    static constexpr uint32_t WheelSlots{65536};
+    static constexpr uint64_t WheelTickNs{1'000};
+    static constexpr uint64_t MaxLagNs{1'000'000};
+    // The kernel limits on a datagram segmented with UDP GSO
+    static constexpr unsigned GsoMaxSegments{64};
+    static constexpr unsigned GsoMaxBytes{65000};
+    static constexpr uint64_t LeadNs{2'000'000};
+    // The schedules of the datagrams not reported by the kernel yet
+    static constexpr uint32_t TxSlots{65536};
+    // The time the kernel is given to report the last datagrams
+    static constexpr uint64_t TxDrainNs{100'000'000};
+
+public:
+    /**
+     * @param pkt the beacon with the hostname filled in
+     */
+    SenderWorker(
+            Config const& cfg, OutputHandler& oh, StopFlag& stopped,
+            unsigned index, MaltBeaconPacket const& pkt)
+    : MaltBase{cfg, oh, stopped}
+    , index_{index}
+    , pkt_(pkt)
+    , beaconSize_{static_cast<unsigned>(
+            sizeof(MaltBeaconHdr) + pkt.hdr.dataLen)}
+    , mix_{cfg.sizes(), beaconSize_}
+    , slotSize_{mix_.maxSize()}
+    , wheel_{flowCount(cfg, index), WheelSlots, WheelTickNs}
+    , batchBuf_(static_cast<std::size_t>(cfg.batch()) * slotSize_)
+    , iovs_(cfg.batch())
+    , pktDsts_(cfg.batch())
+    , dueNs_(cfg.batch())
+    , msgs_(cfg.batch())
+    , cmsgs_(cfg.batch())
+    , batchLen_{0}
+    , msgLen_{0}
+    , gso_{cfg.gso()}
+    , pacing_{cfg.pacing()}
+    , schedNs_(cfg.txTimestamps() ? TxSlots : 0)
+    , txIds_{0}
+    , txReports_{0}
+    , active_{0}
+    , hostNs_{0}
+    , failed_{false}
+    , txStats_{} {}
+
+    bool init() {
+        s_ = socket(AF_INET, SOCK_DGRAM, 0);
+        if (s_ == -1)
+            return sysCallError("unable to create socket");
+
+        if (! configureSenderSocket(cfg_, s_))
+            return false;
+
+        // The kernels before Linux 4.18 don't know the option
+        int gsoOff{0};
+        if (gso_ && setsockopt(s_, IPPROTO_UDP,
+                               UDP_SEGMENT, &gsoOff, sizeof(gsoOff)) == -1) {
+            if (index_ == 0)
+                warning("UDP GSO not supported by host, "
+                        "sending the packets one by one: ", sysError(errno));
+            gso_ = false;
+        }
+
+        auto const& flows = cfg_.flows();
+        for (std::size_t f{index_}; f < flows.size(); f += cfg_.threads()) {
+            Flow flow{};
+            flow.dst.sin_family = AF_INET;
+            flow.dst.sin_port = htons(flows[f].dport);
+            flow.dst.sin_addr.s_addr = flows[f].group.to_nl();
+            flow.rate = flows[f].rate;
+            flow.cost = flows[f].rateUnit == RateUnit::Pps
+                    ? 1 : wireBytes() << 3u;
+            flows_.push_back(flow);
+        }
+
+        for (unsigned i{0}; i < cfg_.batch(); ++i) {
+            uint8_t* slot = &batchBuf_[i * slotSize_];
+            memcpy(slot, &pkt_, beaconSize_);
+            iovs_[i].iov_base = slot;
+            msgs_[i].msg_hdr = msghdr{};
+            msgs_[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        }
+
+        if (! configurePacing())
+            return false;
+
+        if (cfg_.txTimestamps() && ! enableTxTimestamps(s_))
+            return false;
+
+        for (auto& cmsgBuf: cmsgs_) {
+            auto cmsg = reinterpret_cast<cmsghdr*>(cmsgBuf.data);
+            if (pacing_ == PacingMode::TxTime) {
+                cmsg->cmsg_level = SOL_SOCKET;
+                cmsg->cmsg_type = SCM_TXTIME;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+            } else {
+                cmsg->cmsg_level = IPPROTO_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * Sends until all the flows send their count of packets or the
+     * workers are stopped. If the worker fails, it stops the other
+     * workers as well.
+     */
+    bool run() {
+        pinToCpu(index_, "sender");
+
+        uint64_t startNs = monotonicNanos();
+        wheel_.start(startNs);
+        auto flows = static_cast<uint32_t>(flows_.size());
+        for (uint32_t f{0}; f < flows; ++f) {
+            Flow& flow = flows_[f];
+            flow.startNs = startNs + dueOffsetNs(flow, 1) * f / flows;
+            wheel_.schedule(f, flow.startNs);
+        }
+        active_ = flows;
+
+        // The packets due by the horizon are sent in the pass
+        uint64_t leadNs = pacing_ == PacingMode::User ? 0 : LeadNs;
+        while (! stopped_ && active_ > 0) {
+            uint64_t nowNs = monotonicNanos();
+            hostNs_ = TimeUtils::gethostnanos();
+            uint64_t horizonNs = nowNs + leadNs;
+            wheel_.expire(horizonNs,
+                    [this, nowNs, horizonNs] (uint32_t f, uint64_t) {
+                sendDue(f, nowNs, horizonNs);
+            });
+            if (! failed_ && msgLen_ > 0)
+                flush();
+            if (failed_)
+                break;
+
+            if (cfg_.txTimestamps())
+                readTxTimestamps();
+
+            // Each pass of a kernel mode sends half of the lead ahead
+            if (active_ > 0)
+                waitUntil(wheel_.nextExpiryNs() - leadNs / 2);
+        }
+
+        txStats_.durationNanos = monotonicNanos() - startNs;
+        if (cfg_.txTimestamps() && ! failed_)
+            drainTxTimestamps();
+        if (failed_)
+            stopped_ = true;
+
+        return ! failed_;
+    }
+
+    TxStats const& txStats() const { return txStats_; }
+
+private:
+    struct Flow final {
+        sockaddr_in dst;
+        uint64_t rate;
+        // The cost of a packet in the unit of the rate
+        uint64_t cost;
+        uint64_t startNs;
+        // The index of the next packet in the schedule, which is ahead
+        // of the sequence number once any packet was skipped
+        uint64_t next;
+        uint64_t seq;
+    };
+
+    // Either the UDP GSO segment size or the SO_TXTIME launch time
+    struct alignas(cmsghdr) SendCmsgBuf {
+        uint8_t data[CMSG_SPACE(sizeof(uint64_t))];
+    };
+
+    unsigned index_;
+    MaltBeaconPacket pkt_;
+    // The size of the bare beacon
+    unsigned beaconSize_;
+    SizeMix mix_;
+    unsigned slotSize_;
+    std::vector<Flow> flows_;
+    TimerWheel wheel_;
+    // The packets sent with a single sendmmsg() in the slots of the
+    // largest size of the mix, a message carries several consecutive
+    // packets of a flow of the same size with UDP GSO
+    std::vector<uint8_t> batchBuf_;
+    std::vector<iovec> iovs_;
+    std::vector<sockaddr_in*> pktDsts_;
+    std::vector<uint64_t> dueNs_;
+    std::vector<mmsghdr> msgs_;
+    std::vector<SendCmsgBuf> cmsgs_;
+    unsigned batchLen_;
+    unsigned msgLen_;
+    bool gso_;
+    PacingMode pacing_;
+    // The host times the sent datagrams were due at by their send index,
+    // only allocated with the transmit timestamps
+    std::vector<uint64_t> schedNs_;
+    uint32_t txIds_;
+    uint32_t txReports_;
+    // The flows which haven't sent their count of packets yet
+    uint32_t active_;
+    // The host time of the current pass
+    uint64_t hostNs_;
+    bool failed_;
+    TxStats txStats_;
+
+    static uint32_t flowCount(Config const& cfg, unsigned index) {
+        auto flows = static_cast<uint32_t>(cfg.flows().size());
+        return (flows - index + cfg.threads() - 1) / cfg.threads();
+    }
+
+    /**
+     * @return the average size of a packet of the mix with the headers
+     */
+    uint64_t wireBytes() const {
+        return (FlowStats::withHeaders(0) * mix_.period()
+                + mix_.periodBytes() + mix_.period() - 1) / mix_.period();
+    }
+
+    /**
+     * @return the time from the start of the flow the packet is due at
+     */
+    static uint64_t dueOffsetNs(Flow const& flow, uint64_t pkt) {
+        return static_cast<uint64_t>(
+                (static_cast<unsigned __int128>(pkt * flow.cost)
+                 * 1'000'000'000 + flow.rate - 1) / flow.rate);
+    }
+
+    /**
+     * @return the first packet due at or after the time
+     */
+    static uint64_t firstDueAt(Flow const& flow, uint64_t ns) {
+        if (ns <= flow.startNs)
+            return 0;
+
+        auto tokens = static_cast<unsigned __int128>(ns - flow.startNs)
+                * flow.rate;
+        auto perPkt = static_cast<unsigned __int128>(flow.cost)
+                * 1'000'000'000;
+        return static_cast<uint64_t>((tokens + perPkt - 1) / perPkt);
+    }
+
+    /**
+     * Sets up the kernel pacing mode, if it isn't supported by the host,
+     * the worker falls back to pacing the packets on its own
+     */
+    bool configurePacing() {
+        if (pacing_ == PacingMode::TxTime) {
+            sock_txtime txtime{};
+            txtime.clockid = CLOCK_MONOTONIC;
+            if (setsockopt(s_, SOL_SOCKET,
+                           SO_TXTIME, &txtime, sizeof(txtime)) == -1) {
+                if (index_ == 0)
+                    warning("SO_TXTIME not supported by host, pacing "
+                            "the packets in malt: ", sysError(errno));
+                pacing_ = PacingMode::User;
+            }
+        } else if (pacing_ == PacingMode::MaxRate) {
+            uint64_t bytesPerSec{0};
+            for (auto const& flow: flows_) {
+                bytesPerSec += flow.cost == 1
+                        ? flow.rate * wireBytes()
+                        : flow.rate / 8;
+            }
+            // ~0 means no limit to the kernel
+            auto rate = static_cast<uint32_t>(
+                    std::min<uint64_t>(bytesPerSec, UINT32_MAX - 1));
+            if (setsockopt(s_, SOL_SOCKET,
+                           SO_MAX_PACING_RATE, &rate, sizeof(rate)) == -1) {
+                if (index_ == 0)
+                    warning("SO_MAX_PACING_RATE not supported by host, "
+                            "pacing the packets in malt: ", sysError(errno));
+                pacing_ = PacingMode::User;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * Queues the packets of the flow due by the horizon and schedules its
+     * next packet unless the flow sent its count of packets
+     */
+    void sendDue(uint32_t f, uint64_t nowNs, uint64_t horizonNs) {
+        if (failed_)
+            return;
+
+        Flow& flow = flows_[f];
+        if (nowNs > flow.startNs + dueOffsetNs(flow, flow.next) + MaxLagNs) {
+            uint64_t next = firstDueAt(flow, nowNs - MaxLagNs);
+            txStats_.missedDeadlines += next - flow.next;
+            flow.next = next;
+        }
+
+        uint64_t count = cfg_.count();
+        uint64_t dueNs;
+        while ((dueNs = flow.startNs + dueOffsetNs(flow, flow.next))
+                       <= horizonNs
+               && (count == 0 || flow.seq < count)) {
+            if (batchLen_ == pktDsts_.size() && ! flush())
+                return;
+
+            auto slot = static_cast<uint8_t*>(iovs_[batchLen_].iov_base);
+            auto hdr = reinterpret_cast<MaltBeaconHdr*>(slot);
+            hdr->seq = flow.seq;
+            hdr->timeNs = hostNs_ + dueNs - nowNs;
+            unsigned size = mix_.size(flow.seq);
+            padBeacon(slot, beaconSize_, size, flow.seq);
+            iovs_[batchLen_].iov_len = size;
+            dueNs_[batchLen_] = dueNs;
+            queue(&flow.dst);
+            ++flow.next;
+            ++flow.seq;
+        }
+
+        if (count != 0 && flow.seq >= count) {
+            --active_;
+            return;
+        }
+
+        wheel_.schedule(f, flow.startNs + dueOffsetNs(flow, flow.next));
+    }
+
+    /**
+     * Queues the last packet of the batch into a message of its own or,
+     * with UDP GSO, appends it to the previous message of the same
+     * destination and size as the next segment
+     */
+    void queue(sockaddr_in* dst) {
+        pktDsts_[batchLen_] = dst;
+        if (gso_ && msgLen_ > 0) {
+            msghdr& last = msgs_[msgLen_ - 1].msg_hdr;
+            auto size = static_cast<unsigned>(iovs_[batchLen_].iov_len);
+            if (last.msg_name == dst && last.msg_iov->iov_len == size
+                && last.msg_iovlen < std::min(
+                        GsoMaxSegments, GsoMaxBytes / size)) {
+                if (last.msg_iovlen == 1) {
+                    auto cmsg = reinterpret_cast<cmsghdr*>(
+                            cmsgs_[msgLen_ - 1].data);
+                    auto segSize = static_cast<uint16_t>(size);
+                    memcpy(CMSG_DATA(cmsg), &segSize, sizeof(segSize));
+                    last.msg_control = cmsgs_[msgLen_ - 1].data;
+                    last.msg_controllen = sizeof(SendCmsgBuf);
+                }
+                ++last.msg_iovlen;
+                ++batchLen_;
+                return;
+            }
+        }
+
+        queueSingle(batchLen_, msgLen_++);
+        ++batchLen_;
+    }
+
+    void queueSingle(unsigned pkt, unsigned msg) {
+        msghdr& hdr = msgs_[msg].msg_hdr;
+        hdr.msg_name = pktDsts_[pkt];
+        hdr.msg_iov = &iovs_[pkt];
+        hdr.msg_iovlen = 1;
+        if (pacing_ == PacingMode::TxTime) {
+            auto cmsg = reinterpret_cast<cmsghdr*>(cmsgs_[msg].data);
+            memcpy(CMSG_DATA(cmsg), &dueNs_[pkt], sizeof(uint64_t));
+            hdr.msg_control = cmsgs_[msg].data;
+            hdr.msg_controllen = sizeof(SendCmsgBuf);
+        } else {
+            hdr.msg_control = nullptr;
+            hdr.msg_controllen = 0;
+        }
+    }
+
+    /**
+     * Sends the queued messages with sendmmsg(). If the kernel is out of
+     * buffers, the rest of the messages is sent again. If the kernel
+     * refuses to segment a datagram, the rest of the packets is queued
+     * again one by one and GSO is disabled.
+     *
+     * @return false if the send failed
+     */
+    bool flush() {
+        unsigned sent{0};
+        unsigned sentPkts{0};
+        while (sent < msgLen_ && ! stopped_) {
+            int rc = sendmmsg(s_, &msgs_[sent], msgLen_ - sent, 0);
+            if (rc == -1) {
+                if (errno == ENOBUFS || errno == EAGAIN) {
+                    ++txStats_.noBufs;
+                    // Let the device drain its queue
+                    std::this_thread::yield();
+                    continue;
+                }
+                if (errno == EINTR)
+                    continue;
+
+                // The device may lack the checksum offload or the packet
+                // may exceed the MTU
+                if (gso_ && msgs_[sent].msg_hdr.msg_iovlen > 1
+                    && (errno == EIO || errno == EINVAL
+                        || errno == EOPNOTSUPP)) {
+                    warning("UDP GSO refused by the kernel, sending the "
+                            "packets one by one: ", sysError(errno));
+                    gso_ = false;
+                    msgLen_ = batchLen_ - sentPkts;
+                    for (unsigned m{0}; m < msgLen_; ++m)
+                        queueSingle(sentPkts + m, m);
+                    sent = 0;
+                    continue;
+                }
+
+                failed_ = true;
+                return sysCallError("failed to send packets");
+            }
+
+            for (int m{0}; m < rc; ++m) {
+                msghdr const& hdr = msgs_[sent + m].msg_hdr;
+                auto segments = static_cast<unsigned>(hdr.msg_iovlen);
+                if (! schedNs_.empty()) {
+                    auto beacon = static_cast<MaltBeaconHdr const*>(
+                            hdr.msg_iov->iov_base);
+                    schedNs_[txIds_++ % TxSlots] = beacon->timeNs;
+                }
+                for (unsigned i{0}; i < segments; ++i) {
+                    txStats_.bytes +=
+                            FlowStats::withHeaders(hdr.msg_iov[i].iov_len);
+                }
+                if (segments > 1) {
+                    ++txStats_.gsoSends;
+                    txStats_.gsoPkts += segments;
+                }
+                sentPkts += segments;
+            }
+            sent += static_cast<unsigned>(rc);
+        }
+
+        txStats_.pkts += sentPkts;
+        batchLen_ = 0;
+        msgLen_ = 0;
+        return true;
+    }
+
+    /**
+     * Accounts the offsets of the reported transmit times from the
+     * schedule of their datagrams. The reports of the datagrams whose
+     * schedule was already overwritten are ignored.
+     */
+    void readTxTimestamps() {
+        uint32_t id;
+        uint64_t ts;
+        while (readTxTimestamp(s_, id, ts)) {
+            ++txReports_;
+            uint32_t age = txIds_ - id;
+            if (ts == 0 || age == 0 || age > TxSlots)
+                continue;
+
+            txStats_.txOffset(
+                    static_cast<int64_t>(ts - schedNs_[id % TxSlots]));
+        }
+    }
+
+    /**
+     * Waits for the reports of the datagrams still held by the kernel
+     */
+    void drainTxTimestamps() {
+        pollfd pfd{s_, 0, 0};
+        uint64_t deadlineNs = monotonicNanos() + TxDrainNs;
+        while (txReports_ != txIds_ && monotonicNanos() < deadlineNs) {
+            // The error queue is always polled
+            poll(&pfd, 1, 10);
+            readTxTimestamps();
+        }
+    }
+
+    void waitUntil(uint64_t dueNs) {
+        uint64_t spinNs = pacing_ == PacingMode::User ? SpinNanos : 0;
+        uint64_t nowNs = monotonicNanos();
+        if (dueNs > nowNs + spinNs)
+            sleepUntil(dueNs - spinNs);
+
+        while (monotonicNanos() < dueNs && ! stopped_)
+            ;
+    }
+};
+
+// std::min() takes it by reference
+constexpr unsigned SenderWorker::GsoMaxSegments;
+
+} // namespace malt
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace malt {
+
+/**
+ * Tracks the sequence numbers of the beacons of a flow. The sequence
+ * numbers received within the window below the highest one are kept
+ * in a sliding bitmap, thus a packet filling a gap is told from
+ * a duplicate in constant time. The packets older than the window are
+ * late, they can't be told from the duplicates anymore. The bitmap is
+ * allocated with the first beacon, thus the flows carrying no beacons
+ * cost no memory.
+ *
+ * A sender restarts its sequence numbers from 0, thus the sequence
+ * number 0 restarts the tracking. If it is lost, two consecutive late
+ * packets restart the tracking from them. The counters of the previous
+ * runs of the sender are kept.
+ */
+class SeqTracker final {
+    static constexpr uint64_t WindowBits{1024};
+    static constexpr uint64_t Words{WindowBits / 64};
+
+public:
+    /**
+     * @return the number of the packets missing before the sequence
+     * number if it skips any, 0 otherwise
+     */
+    uint64_t add(uint64_t seq) {
+        if (window_.empty()) {
+            window_.resize(Words, 0);
+            restart(seq);
+            return 0;
+        }
+
+        if (seq > highest_) {
+            uint64_t skipped = seq - highest_;
+            clear(highest_ + 1, skipped);
+            set(seq);
+            highest_ = seq;
+            expected_ += skipped;
+            ++unique_;
+            if (skipped == 1)
+                return 0;
+
+            ++gaps_;
+            return skipped - 1;
+        }
+
+        // The sender restarted, within the window its sequence numbers
+        // would be taken for the duplicates
+        if (seq == 0 && highest_ > 0) {
+            ++restarts_;
+            std::fill(window_.begin(), window_.end(), 0);
+            restart(seq);
+            return 0;
+        }
+
+        if (highest_ - seq < WindowBits) {
+            if (isSet(seq)) {
+                ++duplicates_;
+            } else {
+                set(seq);
+                ++unique_;
+                ++reordered_;
+            }
+            return 0;
+        }
+
+        if (seq == probation_) {
+            // The previous packet was counted as late
+            --late_;
+            ++restarts_;
+            std::fill(window_.begin(), window_.end(), 0);
+            restart(seq - 1);
+            add(seq);
+            return 0;
+        }
+
+        probation_ = seq + 1;
+        ++late_;
+        return 0;
+    }
+
+    /**
+     * The counters of the flows received by several workers are only
+     * exact if each worker received all the packets of a flow
+     */
+    void merge(SeqTracker const& st) {
+        expected_ += st.expected_;
+        unique_ += st.unique_;
+        reordered_ += st.reordered_;
+        duplicates_ += st.duplicates_;
+        late_ += st.late_;
+        gaps_ += st.gaps_;
+        restarts_ += st.restarts_;
+    }
+
+    /**
+     * @return the number of the beacons received
+     */
+    uint64_t beacons() const { return unique_ + duplicates_ + late_; }
+
+    /**
+     * @return the number of the sequence numbers between the first and
+     * the highest one of every run of the sender
+     */
+    uint64_t expected() const { return expected_; }
+
+    /**
+     * @return the number of the sequence numbers never received, the
+     * late packets are not lost
+     */
+    uint64_t lost() const {
+        uint64_t received = unique_ + late_;
+        return expected_ > received ? expected_ - received : 0;
+    }
+
+    // The packets which filled a gap within the window
+    uint64_t reordered() const { return reordered_; }
+    uint64_t duplicates() const { return duplicates_; }
+    // The packets older than the window
+    uint64_t late() const { return late_; }
+    // The packets which skipped any sequence number
+    uint64_t gaps() const { return gaps_; }
+    uint64_t restarts() const { return restarts_; }
+
+private:
+    // The bit of a sequence number is seq % WindowBits
+    std::vector<uint64_t> window_;
+    uint64_t highest_{0};
+    // The sequence number confirming a restart after a late packet
+    uint64_t probation_{0};
+    uint64_t expected_{0};
+    uint64_t unique_{0};
+    uint64_t reordered_{0};
+    uint64_t duplicates_{0};
+    uint64_t late_{0};
+    uint64_t gaps_{0};
+    uint64_t restarts_{0};
+
+    void restart(uint64_t seq) {
+        set(seq);
+        highest_ = seq;
+        probation_ = 0;
+        ++expected_;
+        ++unique_;
+    }
+
+    bool isSet(uint64_t seq) const {
+        uint64_t bit = seq % WindowBits;
+        return (window_[bit / 64] >> (bit % 64)) & 1u;
+    }
+
+    void set(uint64_t seq) {
+        uint64_t bit = seq % WindowBits;
+        window_[bit / 64] |= 1ul << (bit % 64);
+    }
+
+    /**
+     * Clears the bits of the sequence numbers the window slides over
+     */
+    void clear(uint64_t seq, uint64_t count) {
+        if (count >= WindowBits) {
+            std::fill(window_.begin(), window_.end(), 0);
+            return;
+        }
+
+        for (uint64_t i{0}; i < count; ++i) {
+            uint64_t bit = (seq + i) % WindowBits;
+            if (bit % 64 == 0 && count - i >= 64) {
+                window_[bit / 64] = 0;
+                i += 63;
+                continue;
+            }
+            window_[bit / 64] &= ~(1ul << (bit % 64));
+        }
+    }
+};
+
+} // namespace malt
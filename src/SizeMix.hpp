@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Config.hpp"
+
+namespace malt {
+
+/**
+ * The sizes of the beacons of a flow by their sequence numbers. The sizes
+ * of the mix are interleaved in proportion to their weights by the smooth
+ * weighted round robin, thus every size is spread over the period of the
+ * mix instead of being sent in a burst, and the mix repeats every total
+ * weight packets. The sizes below the size of the bare beacon are raised
+ * to it.
+ */
+class SizeMix final {
+public:
+    /**
+     * @param sizes the mix, if empty, every beacon is sent bare
+     * @param beaconSize the size of the bare beacon
+     */
+    SizeMix(std::vector<SizeWeight> const& sizes, unsigned beaconSize) {
+        if (sizes.empty()) {
+            pattern_.push_back(beaconSize);
+            return;
+        }
+
+        unsigned total{0};
+        for (auto const& sw: sizes)
+            total += sw.weight;
+
+        std::vector<int64_t> current(sizes.size(), 0);
+        pattern_.reserve(total);
+        for (unsigned i{0}; i < total; ++i) {
+            std::size_t best{0};
+            for (std::size_t s{0}; s < sizes.size(); ++s) {
+                current[s] += sizes[s].weight;
+                if (current[s] > current[best])
+                    best = s;
+            }
+            current[best] -= total;
+            pattern_.push_back(std::max(sizes[best].size, beaconSize));
+        }
+    }
+
+    unsigned size(uint64_t seq) const {
+        return pattern_[seq % pattern_.size()];
+    }
+
+    unsigned maxSize() const {
+        return *std::max_element(pattern_.begin(), pattern_.end());
+    }
+
+    // The number of the packets the mix repeats after
+    std::size_t period() const { return pattern_.size(); }
+
+    // The UDP payload bytes of a period of the mix
+    uint64_t periodBytes() const {
+        uint64_t bytes{0};
+        for (auto size: pattern_)
+            bytes += size;
+        return bytes;
+    }
+
+private:
+    std::vector<unsigned> pattern_;
+};
+
+} // namespace malt
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+#include "vdunlib/unix/SysError.hpp"
+
+#include "AppUtils.hpp"
+#include "PacketInfo.hpp"
+
+namespace malt {
+
+/**
+ * Binds the socket to the specified UDP port on any interface.
+ * The join is sent from the interface specified on the command line
+ */
+inline bool bindUdpPort(int s, uint16_t port) {
+    sockaddr_in src{};
+    memset(&src, 0, sizeof(src));
+    src.sin_family = AF_INET;
+    src.sin_port = htons(port);
+    src.sin_addr.s_addr = INADDR_ANY;
+
+    if (bind(s, reinterpret_cast<sockaddr*>(&src), sizeof(src)) == -1)
+        return error("cannot bind to UDP port ", port, ": ", sysError(errno));
+
+    return true;
+}
+
+/**
+ * Asks the kernel to attach the receive time of every packet as
+ * a SCM_TIMESTAMPNS control message.
+ *
+ * @return true if the timestamps are enabled, false otherwise
+ */
+inline bool enableRxTimestamps(int s) {
+    int on{1};
+    if (setsockopt(s, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == -1) {
+        warning("failed to enable kernel receive timestamps, "
+                "the packets will be timestamped by malt: ", sysError(errno));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @return the receive time in nanoseconds if the control message
+ * is a SCM_TIMESTAMPNS message, 0 otherwise
+ */
+inline uint64_t rxTimestamp(cmsghdr* cmsg) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_TIMESTAMPNS)
+        return 0;
+
+    timespec ts{};
+    memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+    return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000ul
+           + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+/**
+ * The control buffer of a datagram received from a regular UDP socket
+ * with the TTL, the destination address and the timestamp enabled
+ */
+struct alignas(cmsghdr) UdpCmsgBuf {
+    uint8_t data[
+            CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(in_pktinfo))
+            + CMSG_SPACE(sizeof(timespec))];
+};
+
+/**
+ * Asks the kernel to attach the TTL and the destination address of
+ * every datagram received from a regular UDP socket as control
+ * messages. The destination address tells the group of the datagram.
+ */
+inline bool enableUdpRxInfo(int s) {
+    int ttl = 1;
+    if (setsockopt(s, IPPROTO_IP, IP_RECVTTL, &ttl, sizeof(ttl)) == -1)
+        return sysCallError("cannot enable receiving TTL");
+
+    int pktInfo = 1;
+    if (setsockopt(s, IPPROTO_IP,
+            IP_PKTINFO, &pktInfo, sizeof(pktInfo)) == -1)
+        return sysCallError("cannot enable receiving destination address");
+
+    return true;
+}
+
+/**
+ * Fills in the TTL, the group and the timestamp of the packet info from
+ * the control messages of a datagram received from a regular UDP
+ * socket. The fields whose control messages are missing are set to -1
+ * for the TTL and to 0 for the others.
+ */
+inline void parseUdpCmsgs(msghdr* msg, PacketInfo& pinfo) {
+    pinfo.ttl = -1;
+    pinfo.group = net::IPv4Address{};
+    pinfo.timestamp = 0;
+    for (auto cmsg_ptr = CMSG_FIRSTHDR(msg);
+         cmsg_ptr != nullptr;
+         cmsg_ptr = CMSG_NXTHDR(msg, cmsg_ptr)) {
+        if (cmsg_ptr->cmsg_level == IPPROTO_IP
+            && cmsg_ptr->cmsg_type == IP_TTL
+            && cmsg_ptr->cmsg_len > 0) {
+            auto p = static_cast<void *>(CMSG_DATA(cmsg_ptr));
+            pinfo.ttl = static_cast<int16_t>(*static_cast<int *>(p));
+        } else if (cmsg_ptr->cmsg_level == IPPROTO_IP
+                   && cmsg_ptr->cmsg_type == IP_PKTINFO) {
+            in_pktinfo pi{};
+            memcpy(&pi, CMSG_DATA(cmsg_ptr), sizeof(pi));
+            pinfo.group = net::IPv4Address::from_nl(pi.ipi_addr.s_addr);
+        } else if (auto ts = rxTimestamp(cmsg_ptr)) {
+            pinfo.timestamp = ts;
+        }
+    }
+}
+
+/**
+ * Asks the kernel to report the time every datagram sent from the socket
+ * is passed to the device on the error queue of the socket. The reports
+ * carry the index of the send of the datagram, counted from 0.
+ */
+inline bool enableTxTimestamps(int s) {
+    int flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE
+            | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    if (setsockopt(s, SOL_SOCKET,
+                   SO_TIMESTAMPING, &flags, sizeof(flags)) == -1)
+        return sysCallError("cannot enable kernel transmit timestamps");
+
+    return true;
+}
+
+/**
+ * The control buffer of a transmit timestamp report
+ */
+struct alignas(cmsghdr) TxTimestampCmsgBuf {
+    uint8_t data[
+            CMSG_SPACE(sizeof(scm_timestamping))
+            + CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in))];
+};
+
+/**
+ * Reads a report from the error queue of the socket without waiting
+ *
+ * @param id set to the index of the send the report is for
+ * @param timestamp set to the transmit time in nanoseconds, 0 if the
+ * report is not a transmit timestamp
+ * @return false if the error queue is empty
+ */
+inline bool readTxTimestamp(int s, uint32_t& id, uint64_t& timestamp) {
+    TxTimestampCmsgBuf cmsgBuf;
+    msghdr msg{};
+    msg.msg_control = cmsgBuf.data;
+    msg.msg_controllen = sizeof(cmsgBuf.data);
+    if (recvmsg(s, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+        return false;
+
+    id = 0;
+    timestamp = 0;
+    uint64_t ts{0};
+    bool isTimestamp{false};
+    for (auto cmsg = CMSG_FIRSTHDR(&msg);
+         cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET
+            && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            scm_timestamping tss{};
+            memcpy(&tss, CMSG_DATA(cmsg), sizeof(tss));
+            // The software timestamp comes first
+            ts = static_cast<uint64_t>(tss.ts[0].tv_sec) * 1'000'000'000ul
+                 + static_cast<uint64_t>(tss.ts[0].tv_nsec);
+        } else if (cmsg->cmsg_level == IPPROTO_IP
+                   && cmsg->cmsg_type == IP_RECVERR) {
+            sock_extended_err err{};
+            memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            isTimestamp = err.ee_errno == ENOMSG
+                    && err.ee_origin == SO_EE_ORIGIN_TIMESTAMPING;
+            id = err.ee_data;
+        }
+    }
+
+    if (isTimestamp)
+        timestamp = ts;
+
+    return true;
+}
+
+} // namespace malt
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+namespace malt {
+
+/**
+ * A bounded lock-free ring of fixed size slots passed from a single
+ * producer thread to a single consumer thread. Every slot holds a Hdr
+ * followed by the number of the extra bytes specified at construction,
+ * which lets the records carry the data of a runtime size without
+ * an allocation per record.
+ *
+ * The records are written and read in place: the producer fills the
+ * slot returned by reserve() and publishes it with commit(), while
+ * the consumer reads the slot returned by front() and frees it with
+ * pop(). Each side keeps a cached copy of the other side's index and
+ * reloads it only when the ring looks full or empty, thus the indices
+ * don't bounce between the cores for every record.
+ */
+template <typename Hdr>
+class SpscRing final {
+    static constexpr std::size_t CacheLineSize{64};
+
+public:
+    /**
+     * @param slots the number of the slots, a power of two
+     * @param extra the number of the bytes following the Hdr in a slot
+     */
+    SpscRing(unsigned slots, std::size_t extra)
+    : mask_{slots - 1}
+    , stride_{(sizeof(Hdr) + extra + alignof(Hdr) - 1)
+              / alignof(Hdr) * alignof(Hdr)}
+    , slots_{new uint8_t[stride_ * slots + alignof(Hdr)]} {}
+
+    SpscRing(SpscRing const&) = delete;
+    SpscRing& operator= (SpscRing const&) = delete;
+
+    /**
+     * Called by the producer.
+     *
+     * @return the slot to fill in or nullptr if the ring is full
+     */
+    Hdr* reserve() {
+        uint64_t tail = producer_.tail.load(std::memory_order_relaxed);
+        if (tail - producer_.cachedHead > mask_) {
+            producer_.cachedHead =
+                    consumer_.head.load(std::memory_order_acquire);
+            if (tail - producer_.cachedHead > mask_)
+                return nullptr;
+        }
+
+        return slot(tail);
+    }
+
+    /**
+     * Called by the producer to publish the slot returned by reserve()
+     */
+    void commit() {
+        producer_.tail.store(
+                producer_.tail.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+    }
+
+    /**
+     * Called by the consumer.
+     *
+     * @return the oldest published slot or nullptr if the ring is empty
+     */
+    Hdr* front() {
+        uint64_t head = consumer_.head.load(std::memory_order_relaxed);
+        if (head == consumer_.cachedTail) {
+            consumer_.cachedTail =
+                    producer_.tail.load(std::memory_order_acquire);
+            if (head == consumer_.cachedTail)
+                return nullptr;
+        }
+
+        return slot(head);
+    }
+
+    /**
+     * Called by the consumer to free the slot returned by front()
+     */
+    void pop() {
+        consumer_.head.store(
+                consumer_.head.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+    }
+
+    /**
+     * @return the bytes following the Hdr in the slot
+     */
+    static uint8_t* extra(Hdr* hdr) {
+        return reinterpret_cast<uint8_t*>(hdr) + sizeof(Hdr);
+    }
+
+private:
+    struct alignas(CacheLineSize) Producer {
+        std::atomic<uint64_t> tail{0};
+        uint64_t cachedHead{0};
+    };
+
+    struct alignas(CacheLineSize) Consumer {
+        std::atomic<uint64_t> head{0};
+        uint64_t cachedTail{0};
+    };
+
+    uint64_t const mask_;
+    std::size_t const stride_;
+    std::unique_ptr<uint8_t[]> slots_;
+    Producer producer_;
+    Consumer consumer_;
+
+    Hdr* slot(uint64_t index) const {
+        auto base = reinterpret_cast<uintptr_t>(slots_.get());
+        base = (base + alignof(Hdr) - 1) / alignof(Hdr) * alignof(Hdr);
+        return reinterpret_cast<Hdr*>(base + (index & mask_) * stride_);
+    }
+};
+
+} // namespace malt
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace malt {
+
+/**
+ * A hashed timing wheel of the timers identified by small integers.
+ * A timer is scheduled into the slot of its tick and the wheel expires
+ * the slots of the ticks which have fully elapsed, the timers due in
+ * a later revolution of the wheel stay in their slot. Both scheduling
+ * and expiring a timer take constant time and the wheel allocates no
+ * memory once constructed. The occupied slots are tracked in a bitmap,
+ * thus the empty slots are skipped without visiting them.
+ */
+class TimerWheel final {
+    static constexpr uint32_t Nil{UINT32_MAX};
+
+public:
+    /**
+     * @param timers the number of the timer ids
+     * @param slots the number of the slots, a power of 2 and at least 64
+     * @param tickNs the time span of a slot
+     */
+    TimerWheel(uint32_t timers, uint32_t slots, uint64_t tickNs)
+    : tickNs_{tickNs}
+    , mask_{slots - 1}
+    , curTick_{0}
+    , heads_(slots, Nil)
+    , next_(timers, Nil)
+    , due_(timers, 0)
+    , occupied_(slots / 64, 0) {}
+
+    /**
+     * Starts the wheel at the time, no timer may be scheduled before
+     */
+    void start(uint64_t nowNs) { curTick_ = nowNs / tickNs_; }
+
+    /**
+     * Schedules the timer, which must not be scheduled yet. A timer due
+     * in the past is expired with the first tick not expired yet.
+     */
+    void schedule(uint32_t timer, uint64_t dueNs) {
+        due_[timer] = dueNs;
+        uint64_t tick = dueNs / tickNs_;
+        link(timer, tick > curTick_ ? tick : curTick_);
+    }
+
+    /**
+     * Passes the timers of the ticks elapsed by the time in the order
+     * of their ticks to the consumer, which may schedule them again
+     */
+    template <typename Consumer>
+    void expire(uint64_t nowNs, Consumer&& consume) {
+        uint64_t nowTick = nowNs / tickNs_;
+        while (curTick_ < nowTick) {
+            uint64_t tick = nextOccupied();
+            if (tick >= nowTick) {
+                curTick_ = nowTick;
+                break;
+            }
+            // The timers scheduled by the consumer in the past are
+            // expired with the next tick
+            curTick_ = tick + 1;
+
+            auto slot = static_cast<uint32_t>(tick & mask_);
+            uint32_t timer = heads_[slot];
+            heads_[slot] = Nil;
+            occupied_[slot / 64] &= ~(1ul << (slot % 64));
+            while (timer != Nil) {
+                uint32_t next = next_[timer];
+                if (due_[timer] / tickNs_ <= tick)
+                    consume(timer, due_[timer]);
+                else
+                    link(timer, due_[timer] / tickNs_);
+                timer = next;
+            }
+        }
+    }
+
+    /**
+     * @return the time the next occupied slot elapses, it may hold
+     * only the timers of a later revolution
+     */
+    uint64_t nextExpiryNs() const { return (nextOccupied() + 1) * tickNs_; }
+
+private:
+    uint64_t const tickNs_;
+    uint32_t const mask_;
+    // The first tick not expired yet
+    uint64_t curTick_;
+    std::vector<uint32_t> heads_;
+    std::vector<uint32_t> next_;
+    std::vector<uint64_t> due_;
+    std::vector<uint64_t> occupied_;
+
+    void link(uint32_t timer, uint64_t tick) {
+        auto slot = static_cast<uint32_t>(tick & mask_);
+        next_[timer] = heads_[slot];
+        heads_[slot] = timer;
+        occupied_[slot / 64] |= 1ul << (slot % 64);
+    }
+
+    /**
+     * @return the tick of the first occupied slot at or after the
+     * current tick, a revolution later if no slot is occupied
+     */
+    uint64_t nextOccupied() const {
+        auto slots = static_cast<uint64_t>(mask_) + 1;
+        auto slot = static_cast<uint32_t>(curTick_ & mask_);
+        auto words = static_cast<uint32_t>(occupied_.size());
+        uint32_t w = slot / 64;
+        uint64_t bits = occupied_[w] & (~0ul << (slot % 64));
+        for (uint32_t i{0}; i <= words; ++i) {
+            if (bits != 0) {
+                uint64_t found = static_cast<uint64_t>(w) * 64
+                        + static_cast<uint64_t>(__builtin_ctzl(bits));
+                return curTick_ + ((found - slot) & mask_);
+            }
+            w = (w + 1) % words;
+            bits = occupied_[w];
+        }
+        return curTick_ + slots;
+    }
+};
+
+// The vectors are filled with it by reference
+constexpr uint32_t TimerWheel::Nil;
+
+} // namespace malt
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace malt {
+
+/**
+ * The stats of the sent traffic
+ */
+struct TxStats final {
+    uint64_t pkts;
+    // Including the headers as in FlowStats
+    uint64_t bytes;
+    uint64_t durationNanos;
+    // The sends which failed because the kernel was out of buffers,
+    // the packets were sent again
+    uint64_t noBufs;
+    // The deadlines of the unpaced sender passed before their packet
+    // could be sent, the packets were not sent
+    uint64_t missedDeadlines;
+    // The datagrams segmented by the kernel with UDP GSO and the packets
+    // they carried
+    uint64_t gsoSends;
+    uint64_t gsoPkts;
+    // The kernel transmit timestamps of the datagrams and the offsets of
+    // the transmit times from the schedule, the offsets are only valid
+    // if there are any timestamps
+    uint64_t txTimestamps;
+    int64_t minTxOffsetNs;
+    int64_t maxTxOffsetNs;
+    double sumTxOffsetNs;
+    double sumSqTxOffsetNs;
+
+    void txOffset(int64_t offsetNs) {
+        if (txTimestamps == 0 || offsetNs < minTxOffsetNs)
+            minTxOffsetNs = offsetNs;
+        if (txTimestamps == 0 || offsetNs > maxTxOffsetNs)
+            maxTxOffsetNs = offsetNs;
+        ++txTimestamps;
+        sumTxOffsetNs += static_cast<double>(offsetNs);
+        sumSqTxOffsetNs += static_cast<double>(offsetNs) * offsetNs;
+    }
+
+    double avgTxOffsetNs() const { return sumTxOffsetNs / txTimestamps; }
+
+    double stddevTxOffsetNs() const {
+        double avg = avgTxOffsetNs();
+        return std::sqrt(std::max(
+                0.0, sumSqTxOffsetNs / txTimestamps - avg * avg));
+    }
+
+    /**
+     * Adds the stats of a sender worker, the duration is the longest
+     * duration of the workers
+     */
+    void merge(TxStats const& txs) {
+        pkts += txs.pkts;
+        bytes += txs.bytes;
+        durationNanos = std::max(durationNanos, txs.durationNanos);
+        noBufs += txs.noBufs;
+        missedDeadlines += txs.missedDeadlines;
+        gsoSends += txs.gsoSends;
+        gsoPkts += txs.gsoPkts;
+        if (txs.txTimestamps > 0) {
+            minTxOffsetNs = txTimestamps == 0
+                    ? txs.minTxOffsetNs
+                    : std::min(minTxOffsetNs, txs.minTxOffsetNs);
+            maxTxOffsetNs = txTimestamps == 0
+                    ? txs.maxTxOffsetNs
+                    : std::max(maxTxOffsetNs, txs.maxTxOffsetNs);
+            txTimestamps += txs.txTimestamps;
+            sumTxOffsetNs += txs.sumTxOffsetNs;
+            sumSqTxOffsetNs += txs.sumSqTxOffsetNs;
+        }
+    }
+};
+
+} // namespace malt